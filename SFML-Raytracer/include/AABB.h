@@ -2,35 +2,78 @@
 #include "Utilities.h"
 
 
-class AABB
+//Box over either precision, the tracer itself uses the AABB typedef at the bottom
+template<typename T>
+class AABBT
 {
 public:
-	AABB() = default;
-	AABB(const AA::Vec3& min, const AA::Vec3& max) : _min(min), _max(max) { }
+	AABBT() = default;
+	AABBT(const AA::Vec3T<T>& min, const AA::Vec3T<T>& max) : _min(min), _max(max) { }
 
-	bool IntersectedRay(const AA::Ray& ray, double tMin, double tMax);
-	inline AA::Vec3 Min() const { return _min; }
-	inline AA::Vec3 Max() const { return _max; }
+	bool IntersectedRay(const AA::RayT<T>& ray, T tMin, T tMax) const;
+	inline AA::Vec3T<T> Min() const { return _min; }
+	inline AA::Vec3T<T> Max() const { return _max; }
 
-	//Returns AABB that encompases both inputted boxes, used for moving scene elements
-	static AABB SurroundingBox(AABB a, AABB b)
+	//Box that contains nothing, expanding it by anything gives back whatever it was expanded by
+	static AABBT Empty()
+	{
+		return AABBT(AA::Vec3T<T>(INFINITY, INFINITY, INFINITY), AA::Vec3T<T>(-INFINITY, -INFINITY, -INFINITY));
+	}
+
+	inline void Expand(const AABBT& other)
+	{
+		_min = AA::Vec3T<T>::Min(_min, other._min);
+		_max = AA::Vec3T<T>::Max(_max, other._max);
+	}
+
+	inline void Expand(const AA::Vec3T<T>& point)
+	{
+		_min = AA::Vec3T<T>::Min(_min, point);
+		_max = AA::Vec3T<T>::Max(_max, point);
+	}
+
+	inline AA::Vec3T<T> Centroid() const { return (_min + _max) * 0.5; }
+
+	//True once the min has passed the max on any axis, like Empty or the overlap of two boxes that don't touch
+	inline bool IsEmpty() const { return _min.X() > _max.X() || _min.Y() > _max.Y() || _min.Z() > _max.Z(); }
+
+	//Shrinks the box to the slab between min and max on one axis
+	inline void ClampAxis(int axis, T min, T max)
 	{
-		AA::Vec3 small(
-			AA::dMin(a.Min().X(), b.Min().X()),
-			AA::dMin(a.Min().Y(), b.Min().Y()),
-			AA::dMin(a.Min().Z(), b.Min().Z())
-		);
+		_min[axis] = AA::dMax(_min[axis], min);
+		_max[axis] = AA::dMin(_max[axis], max);
+	}
+
+	//Space both boxes cover, check IsEmpty as boxes that don't overlap give back an inside out box
+	static AABBT Intersection(const AABBT& a, const AABBT& b)
+	{
+		return AABBT(AA::Vec3T<T>::Max(a._min, b._min), AA::Vec3T<T>::Min(a._max, b._max));
+	}
+
+	inline T SurfaceArea() const
+	{
+		AA::Vec3T<T> extent = _max - _min;
+		if (extent.X() < 0.0 || extent.Y() < 0.0 || extent.Z() < 0.0) { return 0.0; }
+		return 2.0 * (extent.X() * extent.Y() + extent.Y() * extent.Z() + extent.Z() * extent.X());
+	}
+
+	//Returns the index of the axis the box is widest along
+	inline int LongestAxis() const
+	{
+		AA::Vec3T<T> extent = _max - _min;
+		if (extent.X() > extent.Y() && extent.X() > extent.Z()) { return 0; }
+		return extent.Y() > extent.Z() ? 1 : 2;
+	}
 
-		AA::Vec3 big(
-			AA::dMax(a.Max().X(), b.Max().X()),
-			AA::dMax(a.Max().Y(), b.Max().Y()),
-			AA::dMax(a.Max().Z(), b.Max().Z())
-		);
-		return AABB(small, big);
+	//Returns AABB that encompases both inputted boxes, used for moving scene elements
+	static AABBT SurroundingBox(AABBT a, AABBT b)
+	{
+		return AABBT(AA::Vec3T<T>::Min(a.Min(), b.Min()), AA::Vec3T<T>::Max(a.Max(), b.Max()));
 	}
 
 private:
-	AA::Vec3 _min;
-	AA::Vec3 _max;
+	AA::Vec3T<T> _min;
+	AA::Vec3T<T> _max;
 };
 
+typedef AABBT<AA::Real> AABB;
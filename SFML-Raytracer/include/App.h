@@ -11,10 +11,13 @@
 #include "Mesh.h"
 #include "BvhNode.h"
 #include "JobManager.h"
+#include "TileScheduler.h"
+#include "TaskGraph.h"
 #include "Light.h"
 #include "PointLight.h"
 #include "AreaLight.h"
 #include "VolumeLight.h"
+#include "BvhStats.h"
 
 class App
 {
@@ -46,11 +49,23 @@ private:
 
 	sf::Color CalculatePixel(const double& u, const double& v);
 	void UpdateRenderTexture();
+
+	//Copies rows of the pixel buffer into the texture, has to be on the main thread as it talks to GL
+	void UploadRenderRows(int y, int height);
 	void CreateImage();
-	void CreateImageSegment();
+	void CreateImageTile(const TileScheduler::Tile& tile);
 	void GetColour(const double& u, const double& v, sf::Color& colOut);
 	void GetColourAntiAliasing(const double& u, const double& v, sf::Color& colOut);
 
+	//Prints the stats of every BVH in the scene, or writes them to _bvhStatsPath as JSON
+	void ReportBvhStats(bool asJson);
+
+	//Refit -> trace tiles -> upload as a task graph, built once the tile scheduler knows the frame size
+	void BuildFrameGraph();
+
+	//One bit per key that moves the camera or light, compared against what the frame started with to spot a stale frame
+	uint32_t ReadFrameInput();
+
 	//SFML Stuff
 	const int _width = 800;
 	const int _height = 600;
@@ -69,8 +84,22 @@ private:
 	bool _useBvh = true;
 	bool _useMeshBvh = true;
 	bool _useSAH = true;
+	bool _useDynamicLbvh = true;
 	bool _useMeshSAH = true;
 
+	//Lets the mesh SAH builds split long thin triangles across nodes, slower to build but the trees overlap less
+	bool _useMeshSpatialSplits = true;
+
+	//Checks the SIMD Vec3 against the scalar one at startup and prints anything that differs, zero tolerance means bit for bit
+	bool _checkVec3Backends = false;
+	double _vec3CheckTolerance = 0.0;
+
+	//B prints the BVH stats and J dumps them, tracked so holding the key only reports once
+	bool _bvhStatsKeyDown = false;
+	bool _reportBvhStats = false;
+	bool _dumpBvhStats = false;
+	const char* _bvhStatsPath = "bvh_stats.json";
+
 	double _cameraXBound = 5.0;
 	double _cameraPanSpeed = 1.5;
 	bool _camLeft = true;
@@ -91,10 +120,16 @@ private:
 
 	//Job system stuff
 	const bool _isThreaded = true;
-	std::mutex _divisionMutex;
-	int _currentDivision;
-	const int _totalThreads = 160;	//MUST BE A CLEAN DIVISION OF _width * _height //30 max for laptop 160 for desktop
-	const int _calcsPerDivision;
+	//One job thread per hardware thread, any resolution works as edge tiles are cut short
+	const int _totalThreads;
 	std::unique_ptr<JobManager> _jobManager;
+	std::unique_ptr<TileScheduler> _tileScheduler;
+	const int _tileSize = TileScheduler::kDefaultTileSize;
+	TaskGraph _frameGraph;
+	std::vector<TaskGraph::TaskId> _uploadRowTasks;
+
+	//Input changing part way through a frame cancels the tiles it has left, so the next frame starts with it straight away
+	CancellationToken _frameCancel;
+	uint32_t _frameInput = 0;
 };
 
@@ -10,6 +10,7 @@ public:
 
 	bool IntersectedRay(const AA::Ray& ray, double t_min, double t_max, HitResult& res) override;
 	bool IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max, HitResult& res) override;
+	bool Occluded(const AA::Ray& ray, double t_min, double t_max) override;
 	bool BoundingBox(double t0, double t1, AABB& outBox) const override;
 
 	void Move(AA::Vec3 newPos) override;
@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <ostream>
+#include "LinearBvh.h"
+
+//Measures how good a built LinearBvh is so a drop in build quality shows up here before it shows up in frame times
+class BvhStats
+{
+public:
+	BvhStats() = default;
+	~BvhStats() = default;
+
+	//Walks the tree once, hittables has to be the same list the tree was built from
+	static BvhStats Gather(const std::string& name, const LinearBvh& bvh, const std::vector<Hittable*>& hittables);
+
+	//Readable summary for the console
+	void Print(std::ostream& out) const;
+
+	//Writes a list of trees as one JSON document
+	static void WriteJson(std::ostream& out, const std::vector<BvhStats>& stats);
+
+	std::string _name;
+	uint32_t _primCount = 0;
+	uint32_t _nodeCount = 0;
+	uint32_t _leafCount = 0;
+
+	//LinearBvh::SahCost, interior nodes cost a box test and leaves a test per primitive
+	double _sahCost = 0.0;
+
+	//The four wide copy rays actually walk and how much memory its nodes take
+	uint32_t _wideNodeCount = 0;
+	uint64_t _wideNodeBytes = 0;
+	bool _quantised = false;
+
+	//Leaves at each depth with the root at depth 1
+	std::vector<uint32_t> _leafDepths;
+	uint32_t _maxDepth = 0;
+	double _averageLeafDepth = 0.0;
+
+	//Leaves holding each amount of primitives, index is the primitive count
+	std::vector<uint32_t> _leafSizes;
+
+	//Surface area of where sibling boxes overlap over the surface area of their parents, summed over every interior node
+	//Zero means rays never have to enter both children to find the same point
+	double _overlapRatio = 0.0;
+
+	//Average surface area of a leaf box over the area of the tight bounds of what it holds, 1 means the leaves are as small as they can be
+	double _leafInflation = 0.0;
+
+private:
+	void PrintHistogram(std::ostream& out, const char* title, const std::vector<uint32_t>& counts) const;
+	void WriteJsonTree(std::ostream& out) const;
+};
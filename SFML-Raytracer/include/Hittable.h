@@ -5,6 +5,8 @@
 
 class Light;
 class Material;
+class JobManager;
+class BvhStats;
 
 class Hittable
 {
@@ -27,16 +29,42 @@ public:
 	virtual bool IntersectedRay(const AA::Ray& ray, double t_min, double t_max, HitResult& res) = 0;
 	virtual bool IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max, HitResult& res) = 0;
 
+	//Shadow ray query, true as soon as anything is found between t_min and t_max, no hit details are worked out
+	virtual bool Occluded(const AA::Ray& ray, double t_min, double t_max) = 0;
+
 	//Override function for Drawing a AABB around an object, Bool as some things might not have one like infinite planes and wont be included in the BVH
 	//t0 and t1 used to ensure bounding box follows moving objects over a frame
 	virtual bool BoundingBox(double t0, double t1, AABB& outBox) const = 0;
 
+	//Smallest box around the object without any padding BoundingBox adds for the builders, only used to measure how loose the BVH leaves are
+	virtual bool TightBoundingBox(AABB& outBox) const { return BoundingBox(0.0, 0.0, outBox); }
+
+	//Bounds of the part of the object inside the slab between slabMin and slabMax on one axis, false if nothing is inside it
+	//Spatial split builds use this to cut an object into pieces, anything that can't do better than clamping its box just does that
+	virtual bool ClippedBoundingBox(int axis, double slabMin, double slabMax, AABB& outBox) const
+	{
+		if (!TightBoundingBox(outBox)) { return false; }
+		outBox.ClampAxis(axis, slabMin, slabMax);
+		return !outBox.IsEmpty();
+	}
+
 	//Basic functions for derviatives to implement for their respective object
 	virtual void Move(AA::Vec3 newPos) = 0;
 	virtual void Scale(AA::Vec3 newScale) = 0;
 
+	//Called once a frame before any rays are traced, anything holding its own BVH refits it here rather than on every ray
+	virtual void UpdateBvh(JobManager* jobManager = nullptr) { }
+
+	//Adds the stats of any BVH this object holds to outStats, name says where in the scene it came from
+	virtual void GatherBvhStats(const std::string& name, std::vector<BvhStats>& outStats) const { }
+
+	//Set when Move or Scale changes the bounds so whatever holds this object knows its BVH needs a refit, the holder clears it once it has
+	inline bool IsDirty() const { return _isDirty; }
+	inline void ClearDirty() { _isDirty = false; }
+
 protected:
 	bool _isStatic = false;
+	bool _isDirty = false;
 	std::unique_ptr<Material> _material;
 
 	//Not owned just referenced
@@ -1,18 +1,28 @@
 #pragma once
+#include <atomic>
+#include <mutex>
 #include "Hittable.h"
-#include "BvhNode.h"
+#include "LinearBvh.h"
 
 class Hittables : public Hittable
 {
 public:
 	Hittables() = delete;
-	Hittables(bool isHittableStatic, bool useBvh, bool useSAH);
+	//Lbvh swaps the build over to Morton codes and rebuilds whenever something moved instead of refitting, for lists where most things move every frame
+	Hittables(bool isHittableStatic, bool useBvh, bool useSAH, bool useLbvh = false);
 	~Hittables() override;
 
 	bool IntersectedRay(const AA::Ray& ray, double tmin, double tmax, Hittable::HitResult& res) override;
 	bool IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max, HitResult& res) override;
+	bool Occluded(const AA::Ray& ray, double t_min, double t_max) override;
 	bool BoundingBox(double t0, double t1, AABB& outBox) const override;
-	void ConstructBvh();
+	//A static list's treelet passes can be left to a low priority job when optimiseInBackground is set, the list gets a plain tree
+	//straight away and UpdateBvh swaps the optimised one in once it's ready so the first frames aren't held up by it.
+	//The job reads the list's objects from another thread, so nothing in the list can be added, moved or scaled until it's been swapped in.
+	//The list rebuilding or refitting in the meantime only stops the swap, the old tree is kept
+	void ConstructBvh(JobManager* jobManager = nullptr, bool optimiseInBackground = false);
+	void UpdateBvh(JobManager* jobManager = nullptr) override;
+	void GatherBvhStats(const std::string& name, std::vector<BvhStats>& outStats) const override;
 
 	//Need to be implemented due to inheritance
 	inline void Move(AA::Vec3 pos) override { return; }
@@ -23,6 +33,16 @@ public:
 private:
 	bool _bvhEnabled = true;
 	bool _sahEnabled = false;
-	std::unique_ptr<BvhNode> _bvh;
+	bool _lbvhEnabled = false;
+	std::unique_ptr<LinearBvh> _bvh;
+
+	void BuildOptimisedBvh(LinearBvh::BuildType type, uint32_t generation);
+
+	//Bumped on every build so a background build started before it knows it's out of date
+	std::atomic<uint32_t> _bvhGeneration;
+	std::mutex _optimisedBvhMutex;
+	std::unique_ptr<LinearBvh> _optimisedBvh;
+	uint32_t _optimisedBvhGeneration = 0;
+	std::atomic<bool> _optimisedBvhReady;
 };
 
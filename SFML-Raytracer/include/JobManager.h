@@ -1,9 +1,37 @@
 #pragma once
-#include <functional>
-#include <list>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "MpmcQueue.h"
 #include "PoolableThread.h"
 
+//Flag a long running piece of work checks to see if it should give up early. Nothing gets stopped for it, whoever owns the work
+//has to look at it between chunks and skip the rest, so the jobs still finish and anything waiting on them still wakes up
+class CancellationToken
+{
+public:
+	CancellationToken() : _cancelled(false) { }
+	CancellationToken(const CancellationToken& other) = delete;
+	CancellationToken& operator=(const CancellationToken& other) = delete;
+
+	inline void Cancel() { _cancelled.store(true, std::memory_order_relaxed); }
+	inline void Reset() { _cancelled.store(false, std::memory_order_relaxed); }
+	inline bool IsCancelled() const { return _cancelled.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<bool> _cancelled;
+};
+
+//Pool of worker threads fed from lock free queues, workers only fall back to sleeping on a condition variable once the queues run dry
 class JobManager
 {
 public:
@@ -12,22 +40,145 @@ public:
 	JobManager(int jobQueueSize);
 	~JobManager();
 
+	//Workers always take a high priority job over a low one. Low is for background work nothing is waiting on this frame,
+	//it only gets a thread when there's no frame work to do, but a job that's already started runs to the end so keep them short
+	enum class Priority
+	{
+		HIGH,
+		LOW,
+		COUNT
+	};
 
+
+	//Callable stored inline so queueing a job never allocates. Anything captured has to fit kStorageSize or it won't compile,
+	//capture by reference or point at a struct holding the state instead
 	class Job
 	{
 	public:
-		Job() = delete;
-		Job(std::function<void()> func) : dataProcessingFunction(func) {};
+		static const size_t kStorageSize = 48;
+
+		//Empty job, only there so there's something to pop into
+		Job() = default;
+
+		template<typename Func, typename = typename std::enable_if<!std::is_same<typename std::decay<Func>::type, Job>::value>::type>
+		Job(Func&& func)
+		{
+			typedef typename std::decay<Func>::type Callable;
+			static_assert(sizeof(Callable) <= kStorageSize, "Job callable is too big to store inline, capture less or capture a pointer to it");
+			static_assert(alignof(Callable) <= alignof(std::max_align_t), "Job callable needs more alignment than its inline storage has");
+
+			new (_storage) Callable(std::forward<Func>(func));
+			_invoke = [](void* storage) { (*static_cast<Callable*>(storage))(); };
+			_relocate = [](void* from, void* to)
+			{
+				Callable* callable = static_cast<Callable*>(from);
+				if (to != nullptr)
+				{
+					new (to) Callable(std::move(*callable));
+				}
+				callable->~Callable();
+			};
+		}
+
+		Job(Job&& other) { MoveFrom(other); }
+		Job& operator=(Job&& other)
+		{
+			if (this != &other)
+			{
+				Reset();
+				MoveFrom(other);
+			}
+			return *this;
+		}
+		Job(const Job& other) = delete;
+		Job& operator=(const Job& other) = delete;
+		~Job() { Reset(); }
+
+		inline void operator()() { _invoke(_storage); }
+
+	private:
+		void MoveFrom(Job& other)
+		{
+			if (other._relocate != nullptr)
+			{
+				other._relocate(other._storage, _storage);
+			}
+			_invoke = other._invoke;
+			_relocate = other._relocate;
+			other._invoke = nullptr;
+			other._relocate = nullptr;
+		}
+
+		void Reset()
+		{
+			if (_relocate != nullptr)
+			{
+				_relocate(_storage, nullptr);
+			}
+			_invoke = nullptr;
+			_relocate = nullptr;
+		}
 
-		std::function<void()> dataProcessingFunction;
+		alignas(std::max_align_t) unsigned char _storage[kStorageSize];
+		void (*_invoke)(void* storage) = nullptr;
+
+		//Moves the callable from one storage to another and destroys the original, just destroys it when to is null
+		void (*_relocate)(void* from, void* to) = nullptr;
 	};
 
-	void AddJobToQueue(Job job);
-	void ProcessJobs();
+	//Safe to call from any thread, jobs included. Workers can pick the job up straight away, ProcessJobs is what waits for it
+	void AddJobToQueue(Job job, Priority priority = Priority::HIGH);
+
+	//Same as above but the job only ever runs on the thread that created the JobManager, for work that has to stay there such as
+	//anything touching the window's GL context. It gets picked up the next time that thread is in ProcessJobs or RunMainThreadJobs.
+	//Counts as high priority
+	void AddMainThreadJob(Job job);
+
+	//Long running jobs call this between chunks of work so main thread jobs aren't stuck behind them, does nothing on any other thread
+	void RunMainThreadJobs();
+
+	//The calling thread works through queued jobs alongside the pool, then blocks until every job of the given priority added so far
+	//has finished, including any those jobs queued themselves. Only helps with jobs at that priority or above, so waiting on a frame
+	//never lands the caller in background work. Not for calling from inside a job as it would end up waiting on itself
+	void ProcessJobs(Priority priority = Priority::HIGH);
+
+	//Threads that run jobs during ProcessJobs, the pool plus the thread calling it
+	inline int GetThreadCount() const { return static_cast<int>(_threads.size()) + 1; }
+
+	static const size_t kQueueCapacity = 4096;
 
 private:
-	std::mutex _jobQueueMutex;
-	std::list<Job> _jobQueue;
+	void WorkerLoop();
+
+	struct PriorityLevel
+	{
+		PriorityLevel() : queue(kQueueCapacity), unfinishedJobs(0) { }
+
+		MpmcQueue<Job> queue;
+
+		//Counting latch for ProcessJobs, jobs at this priority that have been added but not finished yet
+		std::atomic<uint32_t> unfinishedJobs;
+	};
+
+	//Pops and runs a single job of lowest or any higher priority, false if those queues were all empty
+	bool RunOneJob(Priority lowest);
+	bool RunOneMainThreadJob();
+	void FinishJob(Priority priority);
+	bool AnyJobsQueued(Priority lowest) const;
+
+	static const int kPriorityCount = static_cast<int>(Priority::COUNT);
+	PriorityLevel _levels[kPriorityCount];
+
+	//Main thread jobs are only a handful a frame so a locked deque is plenty, the count lets the busy path skip the lock
+	std::thread::id _mainThreadId;
+	std::deque<Job> _mainThreadJobs;
+	std::atomic<uint32_t> _mainThreadJobCount;
+
+	//Threads waiting on _wakeUp, pushes only take the mutex to wake someone when this is above zero
+	std::atomic<uint32_t> _sleepingThreads;
+	std::mutex _sleepMutex;
+	std::condition_variable _wakeUp;
+	bool _shuttingDown = false;
+
 	std::vector<std::unique_ptr<PoolableThread>> _threads;
 };
-
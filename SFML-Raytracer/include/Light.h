@@ -16,6 +16,7 @@ public:
 
 	bool IntersectedRay(const AA::Ray& ray, double t_min, double t_max, HitResult& res) override;
 	bool IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max, HitResult& res) override;
+	bool Occluded(const AA::Ray& ray, double t_min, double t_max) override;
 	bool BoundingBox(double t0, double t1, AABB& outBox) const override;
 	void Move(AA::Vec3 newPos) override;
 	void Scale(AA::Vec3 newScale) override;
@@ -44,6 +45,12 @@ public:
 
 protected:
 
+	//Fires the shadow ray at both the static and dynamic objects, stops at the first thing found before the light
+	inline bool IsOccluded(const AA::Ray& shadowRay, double dist)
+	{
+		return (_statics != nullptr && _statics->Occluded(shadowRay, 0.0, dist)) || (_dynamics != nullptr && _dynamics->Occluded(shadowRay, 0.0, dist));
+	}
+
 	AA::Vec3 _position;
 	double _sphereRadius = 0.1;
 	Hittable* _statics = nullptr;
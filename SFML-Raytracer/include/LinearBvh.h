@@ -0,0 +1,276 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <algorithm>
+#include <unordered_map>
+#include <string>
+#include "Utilities.h"
+#include "AABB.h"
+#include "Hittable.h"
+#include "BvhNode.h"
+#include "WideBvh.h"
+
+class JobManager;
+
+//Flattened version of the BvhNode tree, every node lives in one array in depth first order so the left child of an interior node is always the next node along
+//Primitives are referenced through an index array rather than pointers so the same structure works for any list of hittables
+class LinearBvh
+{
+public:
+
+	struct Node
+	{
+		AABB box;
+
+		//Leaf: index of the first primitive in the primitive index array, Interior: index of the right child node
+		uint32_t offset = 0;
+
+		//Amount of primitives in a leaf, zero marks an interior node
+		uint16_t primCount = 0;
+
+		//Axis the node was split along
+		uint8_t axis = 0;
+	};
+
+	enum class BuildType
+	{
+		DUMB,		//BvhNode::DumbConstruction flattened
+		SMART,		//BvhNode::SmartConstruction flattened
+		BINNED_SAH,	//Binned SAH straight into the flat array
+		MORTON,		//LBVH, primitives sorted along a Morton curve and split on the highest differing bit. Worse trees than SAH but cheap enough to redo every frame
+		SPATIAL_SAH	//SBVH, binned SAH that can also cut primitives in two at a plane when the object split's children overlap too much. Slow and always single threaded, meant for static meshes
+	};
+
+	LinearBvh() = default;
+	~LinearBvh() = default;
+
+	//Passing a job manager lets the SAH build spread itself over the thread pool, without one it runs on the calling thread
+	//Whatever the build type, subtrees holding up to the max leaf size are merged into one leaf afterwards wherever the SAH says testing them all is cheaper
+	//Treelet restructuring runs before that merge when SetTreeletPasses asked for it
+	void Build(const std::vector<Hittable*>& hittables, BuildType type, JobManager* jobManager = nullptr);
+	void Clear();
+
+	//Refits every box bottom up around the current primitive bounds keeping the tree shape from the last build
+	//Returns false when the SAH cost has grown past kRefitRebuildRatio of what the build produced, the tree should be rebuilt then
+	bool Refit(const std::vector<Hittable*>& hittables);
+
+	//For when the list the tree was built from gets reordered, primitive i becomes newIndices[i], the tree's shape stays as it is
+	void RemapPrimIndices(const std::vector<uint32_t>& newIndices);
+
+	//Writes the flattened tree out so the build can be skipped next time, key should cover everything the tree was built from and is checked again on load
+	bool Save(const std::string& path, uint64_t key) const;
+
+	//Replaces the tree with one written by Save, fails without touching anything if the file is missing, from another key or doesn't fit primCount primitives
+	bool Load(const std::string& path, uint64_t key, uint32_t primCount);
+
+	//Surface area heuristic cost of the whole tree relative to the root box
+	double SahCost() const;
+
+	//Walks the tree calling intersectPrim(primIndex, closestHit) for every primitive in a leaf the ray reaches, primIndex is an index into the list the tree was built from
+	//closestHit starts as t_max, the callback tests against it and lowers it when it finds a closer hit so boxes past it are skipped from then on
+	//The binary tree is kept for building and refitting, rays go through the four wide copy collapsed from it
+	template<typename PrimFunc>
+	inline bool Traverse(const AA::Ray& ray, double t_min, double t_max, PrimFunc intersectPrim) const { return _wideBvh.Traverse(ray, t_min, t_max, intersectPrim); }
+
+	//Same walk handing over a leaf's primitives together, see WideBvh::TraverseLeaves
+	template<typename LeafFunc>
+	inline bool TraverseLeaves(const AA::Ray& ray, double t_min, double t_max, LeafFunc intersectLeaf) const { return _wideBvh.TraverseLeaves(ray, t_min, t_max, intersectLeaf); }
+
+	//Shadow rays only need to know something is in the way, the callback is bool(uint32_t primIndex) and the first true ends the walk
+	template<typename PrimFunc>
+	inline bool TraverseAny(const AA::Ray& ray, double t_min, double t_max, PrimFunc occludedPrim) const { return _wideBvh.TraverseAny(ray, t_min, t_max, occludedPrim); }
+
+	template<typename LeafFunc>
+	inline bool TraverseAnyLeaves(const AA::Ray& ray, double t_min, double t_max, LeafFunc occludedLeaf) const { return _wideBvh.TraverseAnyLeaves(ray, t_min, t_max, occludedLeaf); }
+
+	//Most primitives a leaf can hold, takes effect on the next build
+	inline void SetMaxLeafPrims(uint32_t maxLeafPrims) { _maxLeafPrims = std::max(1u, std::min(maxLeafPrims, kMaxLeafPrimsLimit)); }
+	inline uint32_t GetMaxLeafPrims() const { return _maxLeafPrims; }
+
+	//Spatial splits are only tried where the best object split's children overlap by more than this fraction of the root's surface area, takes effect on the next build
+	//Zero tries them everywhere, the higher it is the fewer primitives get duplicated
+	inline void SetSpatialSplitAlpha(double alpha) { _spatialSplitAlpha = std::max(alpha, 0.0); }
+	inline double GetSpatialSplitAlpha() const { return _spatialSplitAlpha; }
+
+	//Rounds of treelet restructuring run after the build, each rearranges every small group of nodes into whichever shape of them has the lowest SAH cost
+	//Pays a lot of build time for faster rays so it's meant for trees built once and traced for many frames, zero turns it off, takes effect on the next build
+	inline void SetTreeletPasses(uint32_t passes) { _treeletPasses = passes; }
+	inline uint32_t GetTreeletPasses() const { return _treeletPasses; }
+
+	//Trees over this many primitives collapse into quantised wide nodes half the size of the float ones, zero quantises every tree, takes effect on the next build
+	inline void SetQuantiseMinPrims(uint32_t minPrims) { _quantiseMinPrims = minPrims; }
+	inline uint32_t GetQuantiseMinPrims() const { return _quantiseMinPrims; }
+
+	inline bool IsConstructed() const { return !_nodes.empty(); }
+	inline const std::vector<Node>& GetNodes() const { return _nodes; }
+	inline const std::vector<uint32_t>& GetPrimIndices() const { return _primIndices; }
+	inline const WideBvh& GetWideBvh() const { return _wideBvh; }
+
+	//Deepest tree the builders are allowed to make, keeps the traversal stack a fixed size
+	static const int kMaxStackDepth = 64;
+
+	//SAH weights, the cost of stepping through an interior node and of testing one primitive in a leaf
+	static constexpr double kSahNodeCost = 1.0;
+	static constexpr double kSahPrimCost = 1.0;
+
+	//Leaf sizes the builds start with and never go past
+	static const uint32_t kDefaultMaxLeafPrims = 8;
+	static const uint32_t kMaxLeafPrimsLimit = 64;
+
+	//Buckets per axis the binned builder sorts centroids into when looking for a split
+	static const int kSahBinCount = 16;
+
+	//Below this the float wide nodes stay in cache anyway and their tighter boxes win
+	static const uint32_t kDefaultQuantiseMinPrims = 1u << 17;
+
+	//Leaves of a treelet the restructuring pass rearranges, every way of building a tree over them is tried so the work grows as 3^n
+	static const uint32_t kTreeletLeaves = 7;
+
+	//Passes static geometry asks for, later passes find less and less
+	static const uint32_t kStaticTreeletPasses = 3;
+
+	//Subtrees the treelet pass hands out as jobs before it finishes the nodes above them on the calling thread
+	static const uint32_t kTreeletJobCount = 64;
+
+	//Slices per axis a spatial split build cuts a node into when looking for a plane to split primitives on
+	static const int kSpatialBinCount = 32;
+	static constexpr double kDefaultSpatialSplitAlpha = 1e-5;
+
+	//How much worse the SAH cost is allowed to get through refits before asking for a rebuild
+	static constexpr double kRefitRebuildRatio = 1.5;
+
+	//Threaded builds only kick in past this many primitives, below it the job overhead costs more than the build
+	static const uint32_t kThreadedBuildMinPrims = 32768;
+
+	//Smallest subtree handed to a single job and the size of the slices the per level work is cut into
+	static const uint32_t kThreadedSubtreeMinPrims = 256;
+	static const uint32_t kThreadedChunkSize = 4096;
+
+	//Morton codes use 10 bits per axis up to this many primitives, past it they go to 21 bits per axis so fewer of them share a code
+	static const uint32_t kMortonShortCodeMaxPrims = 1 << 16;
+
+	//Bits the radix sort takes per pass
+	static const int kRadixBits = 8;
+
+	//Bump the version whenever Node or the file layout changes so old cache files are rebuilt instead of misread
+	static const uint32_t kCacheMagic = 0x48564221;
+	static const uint32_t kCacheVersion = 2;
+
+private:
+	//Primitive bounds and centroids worked out once before a build so the builder never calls back into the hittables
+	struct BuildPrims
+	{
+		std::vector<AABB> bounds;
+		std::vector<AA::Vec3> centroids;
+	};
+
+	struct SahBin
+	{
+		AABB box = AABB::Empty();
+		uint32_t count = 0;
+	};
+	typedef std::array<std::array<SahBin, kSahBinCount>, 3> SahBins;
+
+	//Range of the index array still waiting to be split or built, top is the node in the threaded build's top level it belongs to
+	struct PendingRange
+	{
+		uint32_t start;
+		uint32_t end;
+		int depth;
+		uint32_t top;
+	};
+
+	//Start of a saved tree, the node and primitive index arrays follow it as they are in memory
+	struct CacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t nodeSize;
+		uint32_t primCount;
+		uint64_t key;
+		uint32_t nodeCount;
+
+		//Can be more than primCount when spatial splits put a primitive in several leaves
+		uint32_t indexCount;
+	};
+
+	//Part of a primitive a spatial split build is placing, the same primitive can have several with their boxes clipped to different sides of a split
+	struct SpatialRef
+	{
+		AABB box;
+		uint32_t prim;
+	};
+
+	struct MortonPrim
+	{
+		uint64_t code;
+		uint32_t prim;
+	};
+
+	//Node above the subtrees in a threaded build, either split on the main thread or standing in for a whole subtree built by a job
+	struct TopNode
+	{
+		AABB box;
+		uint8_t axis = 0;
+		uint32_t left = 0;
+		uint32_t right = 0;
+		int subtree = -1;
+	};
+
+	void BuildFromBvhNode(const std::vector<Hittable*>& hittables, bool useSmart);
+	void GatherBuildPrims(const std::vector<Hittable*>& hittables, JobManager* jobManager, BuildPrims& outPrims) const;
+	void BuildBinnedSah(const std::vector<Hittable*>& hittables, JobManager* jobManager);
+	void BuildBinnedSahThreaded(const BuildPrims& prims, JobManager* jobManager);
+	uint32_t BuildSahRange(const BuildPrims& prims, uint32_t start, uint32_t end, int depth, std::vector<Node>& nodes);
+	uint32_t EmitTopNode(const std::vector<TopNode>& topNodes, const std::vector<std::vector<Node>>& subtreeNodes, uint32_t topIndex);
+	void FillSahBins(const BuildPrims& prims, uint32_t start, uint32_t end, const AABB& centroidBox, SahBins& bins) const;
+	bool FindSahSplit(const SahBins& bins, uint32_t count, int& outAxis, int& outBin, double& outCost) const;
+	bool MustSplitOnMedian(uint32_t count, int depth) const;
+
+	void BuildMorton(const std::vector<Hittable*>& hittables, JobManager* jobManager);
+	void SortMortonPrims(std::vector<MortonPrim>& mortonPrims, int bitCount, JobManager* jobManager) const;
+	uint32_t BuildMortonRange(const BuildPrims& prims, const std::vector<uint64_t>& codes, uint32_t start, uint32_t end, int depth, std::vector<Node>& nodes) const;
+	uint32_t FindMortonSplit(const std::vector<uint64_t>& codes, uint32_t start, uint32_t end, int depth) const;
+
+	void BuildSpatialSah(const std::vector<Hittable*>& hittables);
+	uint32_t BuildSpatialRange(const std::vector<Hittable*>& hittables, std::vector<SpatialRef>& refs, int depth, double minOverlap);
+	bool FindSpatialSplit(const std::vector<Hittable*>& hittables, const std::vector<SpatialRef>& refs, const AABB& box, int& outAxis, double& outPlane, double& outCost) const;
+	void SplitSpatialRefs(const std::vector<Hittable*>& hittables, const std::vector<SpatialRef>& refs, int axis, double plane, std::vector<SpatialRef>& outLeft, std::vector<SpatialRef>& outRight) const;
+	bool ClipRef(const std::vector<Hittable*>& hittables, const SpatialRef& ref, int axis, double slabMin, double slabMax, AABB& outBox) const;
+
+	//Working copy of the tree for the treelet pass, left children are stored explicitly since restructuring breaks the depth first order until it's written back out
+	//Interior nodes still keep their right child in offset, costs are unnormalised subtree SAH costs
+	struct TreeletTree
+	{
+		std::vector<Node> nodes;
+		std::vector<uint32_t> left;
+		std::vector<double> costs;
+	};
+
+	void OptimiseTreelets(JobManager* jobManager);
+	void OptimiseTreeletSubtree(TreeletTree& tree, uint32_t root) const;
+	void RestructureTreelet(TreeletTree& tree, uint32_t root) const;
+	uint32_t EmitTreeletNode(const TreeletTree& tree, uint32_t index, int depth, int& maxDepth, std::vector<uint32_t>& primIndices);
+
+	void MergeSmallSubtrees();
+	uint32_t EmitMergedNode(const std::vector<Node>& nodes, const std::vector<uint8_t>& merge, const std::vector<uint32_t>& primCounts, uint32_t index);
+
+	uint32_t FlattenNode(Hittable* node, const std::unordered_map<const Hittable*, uint32_t>& lookup, int depth, int& maxDepth);
+	uint32_t AddLeaf(std::initializer_list<const Hittable*> prims, const std::unordered_map<const Hittable*, uint32_t>& lookup);
+
+	std::vector<Node> _nodes;
+	std::vector<uint32_t> _primIndices;
+
+	//Hittables the tree was built over, _primIndices can hold more than this when spatial splits reference a primitive twice
+	uint32_t _primCount = 0;
+
+	uint32_t _maxLeafPrims = kDefaultMaxLeafPrims;
+	double _spatialSplitAlpha = kDefaultSpatialSplitAlpha;
+	uint32_t _treeletPasses = 0;
+	uint32_t _quantiseMinPrims = kDefaultQuantiseMinPrims;
+
+	//Cost of the tree straight after it was built, refits compare against this
+	double _builtSahCost = 0.0;
+
+	WideBvh _wideBvh;
+};
@@ -2,46 +2,36 @@
 #include "Hittable.h"
 #include "Triangle.h"
 #include "Utilities.h"
-#include "BvhNode.h"
+#include "MeshData.h"
 
+//Places a shared MeshData in the scene, rays are moved into the data's object space at the mesh instead of the triangles being moved into world space
 class Mesh : public Hittable
 {
 public:
-	enum class ModelParams
-	{
-		FLIP_X,
-		FLIP_Y,
-		FLIP_Z,
-		DEFAULT
-	};
-
+	typedef MeshData::ModelParams ModelParams;
 
 	Mesh() = delete;
-	Mesh(const char* modelPath, const char* texturePath, AA::Vec3 position, AA::Vec3 scale, bool isStatic, Material* mat,  bool useBvh = false, bool useSmart = false, ModelParams param = ModelParams::DEFAULT, Light* sceneLight = nullptr);
+	Mesh(const char* modelPath, const char* texturePath, AA::Vec3 position, AA::Vec3 scale, bool isStatic, Material* mat,  bool useBvh = false, bool useSmart = false, ModelParams param = ModelParams::DEFAULT, Light* sceneLight = nullptr, JobManager* jobManager = nullptr, bool useSpatialSplits = false);
 	~Mesh() override;
 
 	bool IntersectedRay(const AA::Ray& ray, double t_min, double t_max, HitResult& res) override;
 	bool IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max, HitResult& res) override;
+	bool Occluded(const AA::Ray& ray, double t_min, double t_max) override;
 	bool BoundingBox(double t0, double t1, AABB& outBox) const override;
+	void GatherBvhStats(const std::string& name, std::vector<BvhStats>& outStats) const override;
 
 	void Move(AA::Vec3 newPos) override;
 	void Scale(AA::Vec3 newScale) override;
 
 private:
-	bool LoadModel(const char* path, ModelParams param);
-	bool LoadTexture(const char* path);
-	void UpdateTrisPosition();
-	void UpdateTrisScale();
-	
+	//Direction is only divided by the scale and not normalised so t is the same in both spaces
+	inline AA::Ray ToObjectSpace(const AA::Ray& ray) const { return AA::Ray((ray._startPos - _position) / _scale, ray._dir / _scale); }
+
+	//Walks the shared triangle store with an object space ray, only the closest hit gets shaded when closestOnly is set
+	bool IntersectTris(const AA::Ray& objectRay, double t_min, double t_max, HitResult& res, bool closestOnly) const;
+
 	AA::Vec3 _position = AA::Vec3();
 	AA::Vec3 _scale = AA::Vec3();
-	
-	std::vector<Hittable*> _tris;
 
-	std::unique_ptr<sf::Image> _meshTexture;
-
-	std::unique_ptr<BvhNode> _meshBvh;
-	const bool _useBvh;
-	const bool _useSah;
+	std::shared_ptr<MeshData> _data;
 };
-
@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include "Hittable.h"
+#include "Utilities.h"
+#include "LinearBvh.h"
+#include "TriangleStore.h"
+#include "Triangle.h"
+
+//Triangles loaded from an OBJ in object space along with the BVH built over them
+//Loaded once per model and shared by every Mesh placing it in the scene, the Mesh only holds where and how big it is
+class MeshData
+{
+public:
+	enum class ModelParams
+	{
+		FLIP_X,
+		FLIP_Y,
+		FLIP_Z,
+		DEFAULT
+	};
+
+	MeshData() = delete;
+	MeshData(const MeshData&) = delete;
+	~MeshData();
+
+	//Hands back the already loaded data for a model if something still holds it, otherwise loads the model and builds its BVH
+	//Spatial splits only apply to SAH trees, they cost build time and memory to cut down on overlap from long thin triangles
+	static std::shared_ptr<MeshData> Get(const char* modelPath, const char* texturePath, ModelParams param, bool useBvh, bool useSah, bool useSpatialSplits = false, JobManager* jobManager = nullptr);
+
+	inline const std::vector<Hittable*>& GetTris() const { return _tris; }
+	inline const LinearBvh* GetBvh() const { return _bvh.get(); }
+
+	//Placed corners and edges of _tris in the same order, what the ray tests read
+	inline const TriangleStore& GetStore() const { return _store; }
+	inline const IndexedVertices& GetVertexBuffer() const { return _vertexBuffer; }
+	inline const AABB& GetBounds() const { return _bounds; }
+	inline bool HasTexture() const { return _texture != nullptr; }
+	inline const std::string& GetName() const { return _name; }
+
+private:
+	MeshData(const char* modelPath, const char* texturePath, ModelParams param, bool useBvh, bool useSah, bool useSpatialSplits, JobManager* jobManager);
+
+	bool LoadModel(const char* path, ModelParams param);
+	bool LoadTexture(const char* path);
+
+	//Reads the tree for this model and build out of the BVH cache if it's there, otherwise builds it and saves it for next time
+	void LoadOrBuildBvh(const char* modelPath, ModelParams param, LinearBvh::BuildType type, JobManager* jobManager);
+
+	//Puts the triangles in the order the BVH's leaves reach them so a leaf's triangles sit next to each other in the store
+	void SortTrisToLeafOrder();
+
+	//Hash of the OBJ's bytes along with every setting that changes the tree, false if the file can't be read
+	static bool BvhCacheKey(const char* modelPath, ModelParams param, LinearBvh::BuildType type, uint32_t maxLeafPrims, uint32_t treeletPasses, double spatialSplitAlpha, uint64_t& outKey);
+
+	//Path the model was loaded from
+	std::string _name;
+	std::vector<Hittable*> _tris;
+
+	//Every triangle's corners, the triangles only hold where theirs start in the index buffer
+	IndexedVertices _vertexBuffer;
+	std::unique_ptr<sf::Image> _texture;
+	std::unique_ptr<LinearBvh> _bvh;
+	TriangleStore _store;
+	AABB _bounds = AABB::Empty();
+
+	//Built trees are saved here named by their cache key, the folder has to exist already
+	static constexpr const char* kBvhCacheDir = "assets/BvhCache/";
+
+	//Weak so a model is freed once the last Mesh using it is gone
+	static std::unordered_map<std::string, std::weak_ptr<MeshData>> _loadedMeshes;
+};
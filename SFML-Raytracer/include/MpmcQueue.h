@@ -0,0 +1,156 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+//Bounded ring buffer any number of threads can push to and pop from without a lock, after Dmitry Vyukov's bounded MPMC queue
+//Each cell carries a sequence number saying whether it's waiting to be written or read on the current lap of the ring,
+//so a push or pop only has to win a single compare exchange on its end of the queue
+template<typename T>
+class MpmcQueue
+{
+public:
+	MpmcQueue() = delete;
+	//Capacity is rounded up to a power of two
+	MpmcQueue(size_t capacity);
+	~MpmcQueue();
+	MpmcQueue(const MpmcQueue& other) = delete;
+	MpmcQueue& operator=(const MpmcQueue& other) = delete;
+
+	//False when the queue is full, value is only moved from when the push succeeds
+	bool TryPush(T&& value);
+
+	//False when there's nothing ready to take
+	bool TryPop(T& outValue);
+
+	//Only a hint while other threads are pushing and popping, a push that has claimed its slot but not filled it yet already counts
+	inline bool IsEmpty() const { return _enqueuePos.load() == _dequeuePos.load(); }
+
+	inline size_t Capacity() const { return _mask + 1; }
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	static const size_t kCacheLineSize = 64;
+
+	std::unique_ptr<Cell[]> _cells;
+	size_t _mask;
+
+	//Padding keeps producers and consumers from bouncing the same cache line between them
+	char _padding0[kCacheLineSize];
+	std::atomic<size_t> _enqueuePos;
+	char _padding1[kCacheLineSize - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> _dequeuePos;
+	char _padding2[kCacheLineSize - sizeof(std::atomic<size_t>)];
+};
+
+template<typename T>
+MpmcQueue<T>::MpmcQueue(size_t capacity)
+{
+	size_t size = 2;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	_cells = std::unique_ptr<Cell[]>(new Cell[size]);
+	_mask = size - 1;
+	for (size_t i = 0; i < size; ++i)
+	{
+		_cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	_enqueuePos.store(0, std::memory_order_relaxed);
+	_dequeuePos.store(0, std::memory_order_relaxed);
+}
+
+template<typename T>
+MpmcQueue<T>::~MpmcQueue()
+{
+	//Nothing else can be touching the queue by now, so everything between the two ends is a live value
+	for (size_t pos = _dequeuePos.load(); pos != _enqueuePos.load(); ++pos)
+	{
+		reinterpret_cast<T*>(_cells[pos & _mask].storage)->~T();
+	}
+}
+
+template<typename T>
+bool MpmcQueue<T>::TryPush(T&& value)
+{
+	Cell* cell;
+	size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+	while (true)
+	{
+		cell = &_cells[pos & _mask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+		//Cell is free on this lap, try to claim it
+		if (difference == 0)
+		{
+			if (_enqueuePos.compare_exchange_weak(pos, pos + 1))
+			{
+				break;
+			}
+		}
+		//Cell still holds a value from the last lap that nobody has popped, so the ring is full
+		else if (difference < 0)
+		{
+			return false;
+		}
+		//Another producer got here first
+		else
+		{
+			pos = _enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	new (cell->storage) T(std::move(value));
+	cell->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+template<typename T>
+bool MpmcQueue<T>::TryPop(T& outValue)
+{
+	Cell* cell;
+	size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+	while (true)
+	{
+		cell = &_cells[pos & _mask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+
+		//Cell has been written on this lap, try to claim it
+		if (difference == 0)
+		{
+			if (_dequeuePos.compare_exchange_weak(pos, pos + 1))
+			{
+				break;
+			}
+		}
+		//Nothing written here yet
+		else if (difference < 0)
+		{
+			return false;
+		}
+		//Another consumer got here first
+		else
+		{
+			pos = _dequeuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	T* value = reinterpret_cast<T*>(cell->storage);
+	outValue = std::move(*value);
+	value->~T();
+
+	//Frees the cell for the producer on the next lap round
+	cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+	return true;
+}
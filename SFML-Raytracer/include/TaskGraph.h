@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+class JobManager;
+
+//Set of tasks with dependencies between them, each task is queued as a job the moment its last predecessor finishes rather than
+//waiting on a barrier for the whole previous stage. Build it once and Run it every frame, running doesn't allocate
+class TaskGraph
+{
+public:
+	typedef uint32_t TaskId;
+
+	enum class Affinity
+	{
+		ANY_THREAD,
+		//Runs on the thread that created the JobManager, see JobManager::AddMainThreadJob
+		MAIN_THREAD
+	};
+
+	TaskGraph() = default;
+	~TaskGraph() = default;
+	TaskGraph(const TaskGraph& other) = delete;
+	TaskGraph& operator=(const TaskGraph& other) = delete;
+
+	//Task starts once everything in dependsOn has finished, or straight away when Run is called if it has no predecessors
+	TaskId AddTask(std::function<void()> func, std::initializer_list<TaskId> dependsOn = {}, Affinity affinity = Affinity::ANY_THREAD);
+
+	//Adds a continuation after a task that already exists
+	void AddDependency(TaskId before, TaskId after);
+
+	//Makes the task also wait on a Signal call, for when what it waits on isn't a task in the graph, like a row of tiles finishing
+	void AddSignalDependency(TaskId task);
+
+	//Safe to call from any thread while the graph is running, once per signal dependency added
+	void Signal(TaskId task);
+
+	//Runs every task and returns once the last one has finished. Uses ProcessJobs to wait, so like it can't be called from inside a job.
+	//Without a JobManager everything runs in order on the calling thread
+	void Run(JobManager* jobManager);
+
+	void Clear();
+
+	inline uint32_t GetTaskCount() const { return static_cast<uint32_t>(_tasks.size()); }
+
+private:
+	struct Task
+	{
+		std::function<void()> func;
+		std::vector<TaskId> successors;
+		Affinity affinity;
+		uint32_t predecessorCount;
+	};
+
+	//Hands the task to the JobManager, or the ready list when there isn't one
+	void Launch(TaskId task);
+	void Execute(TaskId task);
+
+	std::vector<Task> _tasks;
+
+	//Predecessors and signals each task is still waiting on this run, kept apart from _tasks as atomics can't be moved
+	std::unique_ptr<std::atomic<uint32_t>[]> _pendingCounts;
+	uint32_t _pendingCountsSize = 0;
+
+	JobManager* _jobManager = nullptr;
+	std::vector<TaskId> _readyTasks;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class JobManager;
+class CancellationToken;
+
+//Splits a frame into square tiles and hands them out to the job threads. Each worker starts with its own run of tiles
+//in a deque and once that runs dry it steals from the other end of someone else's, so no thread sits idle while tiles are left
+class TileScheduler
+{
+public:
+
+	struct Tile
+	{
+		int x;
+		int y;
+		int width;
+		int height;
+	};
+
+	TileScheduler() = delete;
+	TileScheduler(int tileSize);
+	~TileScheduler() = default;
+
+	//Rebuilds the tile list, edge tiles are cut short so the frame doesn't have to divide evenly into tiles
+	void Resize(int frameWidth, int frameHeight, int workerCount);
+
+	//Calls renderTile once for every tile across the job threads, returns once the last tile is finished
+	void RenderFrame(JobManager* jobManager, const std::function<void(const Tile&)>& renderTile);
+
+	//Queues the frame without waiting on it, for when it's one stage of a TaskGraph. onRowFinished gets the index of each row of tiles
+	//as its last tile is done, from whichever thread did it, so later stages can start on that row while the rest are still tracing.
+	//Once cancel is set the tiles left are skipped rather than rendered, rows still get reported so anything waiting on them carries on
+	void QueueFrame(JobManager* jobManager, std::function<void(const Tile&)> renderTile, std::function<void(int)> onRowFinished = nullptr, const CancellationToken* cancel = nullptr);
+
+	inline int GetTileSize() const { return _tileSize; }
+	inline uint32_t GetTileCount() const { return static_cast<uint32_t>(_tiles.size()); }
+	inline int GetRowCount() const { return _rowCount; }
+
+	//Pixel rows covered by a row of tiles, the last one is cut short like its tiles
+	inline int GetRowY(int row) const { return row * _tileSize; }
+	inline int GetRowHeight(int row) const { return _tiles[row * _tilesPerRow].height; }
+
+	//False when cancelling the last frame meant some of the row's tiles were skipped
+	inline bool IsRowComplete(int row) const { return _rowTilesSkipped[row].load() == 0; }
+
+	//How many tiles had to be taken from another worker's deque last frame
+	inline uint32_t GetStealCount() const { return _stealCount; }
+
+	static const int kDefaultTileSize = 16;
+
+private:
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<uint32_t> tiles;
+	};
+
+	void WorkerLoop(int worker);
+
+	//Owner takes from the front, the same order the tiles were handed out in, thieves take from the back so they stay out of its way
+	bool PopLocal(int worker, uint32_t& outTile);
+	bool Steal(int worker, uint32_t& outTile);
+
+	int _tileSize;
+	int _tilesPerRow = 0;
+	int _rowCount = 0;
+	std::vector<Tile> _tiles;
+	std::vector<std::unique_ptr<WorkerQueue>> _queues;
+	std::atomic<uint32_t> _stealCount;
+
+	//Kept for the frame being rendered as the worker jobs only hold a pointer back to the scheduler
+	JobManager* _jobManager = nullptr;
+	std::function<void(const Tile&)> _renderTile;
+	std::function<void(int)> _onRowFinished;
+	const CancellationToken* _cancel = nullptr;
+	std::unique_ptr<std::atomic<uint32_t>[]> _rowTilesLeft;
+	std::unique_ptr<std::atomic<uint32_t>[]> _rowTilesSkipped;
+};
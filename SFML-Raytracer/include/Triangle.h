@@ -1,29 +1,53 @@
 #pragma once
 #include "Hittable.h"
 
+//Vertices shared by every triangle of a model, each vertex is stored once and triangles pick their three corners out of it by index
+struct IndexedVertices
+{
+	std::vector<AA::Vertex> vertices;
+
+	//Three per triangle in winding order
+	std::vector<uint32_t> indices;
+};
+
 class Triangle : public Hittable
 {
 public:
 	Triangle() = delete;
-	Triangle(std::array<AA::Vertex, 3> verts, AA::Vec3 position, AA::Vec3 scale, sf::Image* texPtr, bool isStatic, Material* mat, Light* sceneLight = nullptr);
+
+	//The buffer is only referenced, it has to outlive the triangle and can't have indices removed while it's in use
+	Triangle(const IndexedVertices* buffer, uint32_t firstIndex, AA::Vec3 position, AA::Vec3 scale, sf::Image* texPtr, bool isStatic, Material* mat, Light* sceneLight = nullptr);
 	~Triangle() override;
 
 	bool IntersectedRay(const AA::Ray& ray, double t_min, double t_max, HitResult& res) override;
 	bool IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max, HitResult& res) override;
+	bool Occluded(const AA::Ray& ray, double t_min, double t_max) override;
 	bool BoundingBox(double t0, double t1, AABB& outBox) const override;
+	bool TightBoundingBox(AABB& outBox) const override;
+	bool ClippedBoundingBox(int axis, double slabMin, double slabMax, AABB& outBox) const override;
 
 	void Move(AA::Vec3 newPos) override;
 	void Scale(AA::Vec3 newScale) override;
 
+	//Corners with the position and scale applied
+	std::array<AA::Vec3, 3> PlacedCorners() const;
+
+	//Fills in everything but the lighting for a hit already found at t with barycentric co ords u and v, lets a TriangleStore do the test and come back here for the shading
+	void ShadeHit(const AA::Ray& ray, double t, double u, double v, HitResult& res);
+
 private:
 
+	//Moller Trumbore against the placed tri, gives back the distance and barycentric co ords of a hit inside the range
+	bool IntersectTri(const AA::Ray& ray, double t_min, double t_max, double& outT, double& outU, double& outV) const;
 	sf::Color GetPixelColour(double u, double v);
 
-	const std::array<AA::Vertex, 3> _verts;
+	inline const AA::Vertex& Vert(int corner) const { return _buffer->vertices[_buffer->indices[_firstIndex + corner]]; }
+
+	const IndexedVertices* _buffer;
+	uint32_t _firstIndex;
 	AA::Vec3 _pos;
 	AA::Vec3 _scale;
 	sf::Image* _texturePtr;
-	std::array<AA::Vec3, 2> _bounds;
 	Material* _materialRaw = nullptr;
 };
 
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Utilities.h"
+#include "Hittable.h"
+
+//Just what the ray tests need from a list of triangles, the first corner and both edges out of it already placed and laid out an axis per array
+//The Triangles they came from stay as the cold data, only read once the closest hit is known to fill in its normal and colour
+class TriangleStore
+{
+public:
+	TriangleStore() = default;
+	~TriangleStore() = default;
+
+	//Every entry has to be a Triangle, entry i of the store is triangle i of the list
+	void Build(const std::vector<Hittable*>& tris);
+	void Clear();
+
+	//Same Moller Trumbore as Triangle::IntersectTri, hits behind or facing away are skipped and t has to land inside the range
+	inline bool Intersect(uint32_t index, const AA::Ray& ray, double t_min, double t_max, double& outT, double& outU, double& outV) const;
+
+	//Closest hit among a list of triangles, such as a BVH leaf. Gives back exactly what calling Intersect on each in turn with a shrinking t_max would
+	//Runs four triangles at a time with AVX when the CPU has it and the tracer is built in double, one at a time otherwise
+	bool IntersectNearest(const uint32_t* indices, uint32_t count, const AA::Ray& ray, double t_min, double t_max, uint32_t& outIndex, double& outT, double& outU, double& outV) const;
+
+	inline bool UsesAvx() const { return _useAvx; }
+
+	inline uint32_t Size() const { return static_cast<uint32_t>(_v0X.size()); }
+
+private:
+	bool IntersectNearestScalar(const uint32_t* indices, uint32_t count, const AA::Ray& ray, double t_min, double t_max, uint32_t& outIndex, double& outT, double& outU, double& outV) const;
+	bool IntersectNearestAvx(const uint32_t* indices, uint32_t count, const AA::Ray& ray, double t_min, double t_max, uint32_t& outIndex, double& outT, double& outU, double& outV) const;
+
+	//Checked once when the store is built
+	static bool CpuSupportsAvx();
+
+	bool _useAvx = false;
+
+	std::vector<AA::Real> _v0X, _v0Y, _v0Z;
+	std::vector<AA::Real> _edge1X, _edge1Y, _edge1Z;
+	std::vector<AA::Real> _edge2X, _edge2Y, _edge2Z;
+};
+
+inline bool TriangleStore::Intersect(uint32_t index, const AA::Ray& ray, double t_min, double t_max, double& outT, double& outU, double& outV) const
+{
+	AA::Vec3 v0v1(_edge1X[index], _edge1Y[index], _edge1Z[index]);
+	AA::Vec3 v0v2(_edge2X[index], _edge2Y[index], _edge2Z[index]);
+	AA::Vec3 pvec = ray._dir.CrossProduct(v0v2);
+	float det = v0v1.DotProduct(pvec);
+
+	if (det < AA::kEpsilon)
+	{
+		return false;
+	}
+
+	float invDet = 1 / det;
+
+	AA::Vec3 tvec = ray._startPos - AA::Vec3(_v0X[index], _v0Y[index], _v0Z[index]);
+	outU = tvec.DotProduct(pvec) * invDet;
+	if (outU < 0 || outU > 1)
+	{
+		return false;
+	}
+
+	AA::Vec3 qvec = tvec.CrossProduct(v0v1);
+	outV = ray._dir.DotProduct(qvec) * invDet;
+	if (outV < 0 || outU + outV > 1)
+	{
+		return false;
+	}
+
+	outT = v0v2.DotProduct(qvec) * invDet;
+	return outT > t_min && outT < t_max;
+}
@@ -5,6 +5,7 @@
 #include <random>
 #include <vector>
 #include <array>
+#include "Vec3Simd.h"
 
 
 namespace AA
@@ -12,16 +13,31 @@ namespace AA
 	static const double PI = 3.14159265358979323846;
 	static const float kEpsilon = 1e-8;
 
-	class Vec3
+	//Scalar the tracer's maths runs in, define AA_SINGLE_PRECISION in the project's preprocessor settings to build it all in float.
+	//kHitEpsilon is how far a ray has to travel before a hit counts, kEpsilon is still used for the parallel/degenerate checks
+#ifdef AA_SINGLE_PRECISION
+	typedef float Real;
+	//Floats only hold ~7 significant digits so bounced rays need pushing further off the surface or they hit it again
+	static const Real kHitEpsilon = 1e-4f;
+#else
+	typedef double Real;
+	static const Real kHitEpsilon = kEpsilon;
+#endif
+
+	//Plain version of Vec3, the tracer uses it through Vec3T when AA_SCALAR_VEC3 is defined or for types Vec3Simd doesn't cover
+	template<typename T>
+	class Vec3Scalar
 	{
 	public:
-		Vec3()
+		typedef T Scalar;
+
+		Vec3Scalar()
 		{
 			_e[0] = 0;
 			_e[1] = 0;
 			_e[2] = 0;
 		}
-		Vec3(const double& x, const double& y, const double& z) 
+		Vec3Scalar(const T& x, const T& y, const T& z) 
 		{
 			_e[0] = x;
 			_e[1] = y;
@@ -29,55 +45,55 @@ namespace AA
 		}
 
 		//Accessors
-		inline double X() const { return _e[0]; }
-		inline double Y() const { return _e[1]; }
-		inline double Z() const { return _e[2]; }
-		inline double R() const { return _e[0]; }
-		inline double G() const { return _e[1]; }
-		inline double B() const { return _e[2]; }
-		inline double operator[](int i) const { return _e[i]; }
-		inline double& operator[](int i) { return _e[i]; }
+		inline T X() const { return _e[0]; }
+		inline T Y() const { return _e[1]; }
+		inline T Z() const { return _e[2]; }
+		inline T R() const { return _e[0]; }
+		inline T G() const { return _e[1]; }
+		inline T B() const { return _e[2]; }
+		inline T operator[](int i) const { return _e[i]; }
+		inline T& operator[](int i) { return _e[i]; }
 
 
 		//Operators
-		inline Vec3 operator + (const Vec3& rh) const
+		inline Vec3Scalar operator + (const Vec3Scalar& rh) const
 		{
-			return Vec3(_e[0] + rh.X(), _e[1] + rh.Y(), _e[2] + rh.Z());
+			return Vec3Scalar(_e[0] + rh.X(), _e[1] + rh.Y(), _e[2] + rh.Z());
 		}
 
-		inline Vec3 operator - (const Vec3& rh) const
+		inline Vec3Scalar operator - (const Vec3Scalar& rh) const
 		{
-			return Vec3(_e[0] - rh.X(), _e[1] - rh.Y(), _e[2] - rh.Z());
+			return Vec3Scalar(_e[0] - rh.X(), _e[1] - rh.Y(), _e[2] - rh.Z());
 		}
 
-		inline Vec3 operator / (const Vec3& rh) const
+		inline Vec3Scalar operator / (const Vec3Scalar& rh) const
 		{
-			return Vec3(_e[0] / rh.X(), _e[1] / rh.Y(), _e[2] / rh.Z());
+			return Vec3Scalar(_e[0] / rh.X(), _e[1] / rh.Y(), _e[2] / rh.Z());
 		}
 
-		inline Vec3 operator / (const double& rh) const
+		inline Vec3Scalar operator / (const T& rh) const
 		{
-			return Vec3(_e[0] / rh, _e[1] / rh, _e[2] / rh);
+			return Vec3Scalar(_e[0] / rh, _e[1] / rh, _e[2] / rh);
 		}
 
-		inline Vec3 operator * (const Vec3& rh) const
+		inline Vec3Scalar operator * (const Vec3Scalar& rh) const
 		{
-			return Vec3(_e[0] * rh.X(), _e[1] * rh.Y(), _e[2] * rh.Z());
+			return Vec3Scalar(_e[0] * rh.X(), _e[1] * rh.Y(), _e[2] * rh.Z());
 		}
 
-		inline Vec3 operator * (const double& rh) const
+		inline Vec3Scalar operator * (const T& rh) const
 		{
-			return Vec3(_e[0] * rh, _e[1] * rh, _e[2] * rh);
+			return Vec3Scalar(_e[0] * rh, _e[1] * rh, _e[2] * rh);
 		}
 
-		inline Vec3& operator -= (const Vec3& rh)
+		inline Vec3Scalar& operator -= (const Vec3Scalar& rh)
 		{
 			_e[0] -= rh.X();
 			_e[1] -= rh.Y();
 			_e[2] -= rh.Z();
 			return *this;
 		}
-		inline Vec3& operator += (const Vec3& rh)
+		inline Vec3Scalar& operator += (const Vec3Scalar& rh)
 		{
 			_e[0] += rh.X();
 			_e[1] += rh.Y();
@@ -85,7 +101,7 @@ namespace AA
 			return *this;
 		}
 
-		inline Vec3& operator += (const double& rh)
+		inline Vec3Scalar& operator += (const T& rh)
 		{
 			_e[0] += rh;
 			_e[1] += rh;
@@ -93,28 +109,28 @@ namespace AA
 			return *this;
 		}
 
-		inline Vec3& operator *= (const Vec3& rh)
+		inline Vec3Scalar& operator *= (const Vec3Scalar& rh)
 		{
 			_e[0] *= rh.X();
 			_e[1] *= rh.Y();
 			_e[2] *= rh.Z();
 			return *this;
 		}
-		inline Vec3& operator *= (const double& rh)
+		inline Vec3Scalar& operator *= (const T& rh)
 		{
 			_e[0] *= rh;
 			_e[1] *= rh;
 			_e[2] *= rh;
 			return *this;
 		}
-		inline Vec3& operator /= (const Vec3& rh)
+		inline Vec3Scalar& operator /= (const Vec3Scalar& rh)
 		{
 			_e[0] /= rh.X();
 			_e[1] /= rh.Y();
 			_e[2] /= rh.Z();
 			return *this;
 		}
-		inline Vec3& operator /= (const double& rh)
+		inline Vec3Scalar& operator /= (const T& rh)
 		{
 			_e[0] /= rh;
 			_e[1] /= rh;
@@ -122,64 +138,86 @@ namespace AA
 			return *this;
 		}
 
-		inline bool operator == (const Vec3& other) const
+		inline bool operator == (const Vec3Scalar& other) const
 		{
 			return _e[0] == other.X() && _e[1] == other.Y() && _e[2] == other.Z();
 		}
 
-		inline bool operator != (const Vec3& other) const
+		inline bool operator != (const Vec3Scalar& other) const
 		{
 			return _e[0] != other.X() && _e[1] != other.Y() && _e[2] != other.Z();
 		}
 
 		//Vector math functions
-		inline double DotProduct(const Vec3& b) const
+		inline T DotProduct(const Vec3Scalar& b) const
 		{
 			return ((_e[0] * b.X()) + (_e[1] * b.Y()) + (_e[2] * b.Z()));
 		}
 
-		inline Vec3 CrossProduct(const Vec3& b) const
+		inline Vec3Scalar CrossProduct(const Vec3Scalar& b) const
 		{
-			return Vec3(
+			return Vec3Scalar(
 				_e[1] * b.Z() - _e[2] * b.Y(),
 				_e[2] * b.X() - _e[0] * b.Z(),
 				_e[0] * b.Y() - _e[1] * b.X()
 			);
 		}
 
-		inline double Length() const
+		inline T Length() const
 		{
-			return sqrt(_e[0] * _e[0] + _e[1] * _e[1] + _e[2] * _e[2]);
+			return std::sqrt(_e[0] * _e[0] + _e[1] * _e[1] + _e[2] * _e[2]);
 		}
 
-		inline double SqrLength() const
+		inline T SqrLength() const
 		{
 			return _e[0] * _e[0] + _e[1] * _e[1] + _e[2] * _e[2];
 		}
 		
-		inline double Distance(Vec3 rhs)
+		inline T Distance(Vec3Scalar rhs)
 		{
-			return sqrt( ((_e[0] - rhs[0]) * (_e[0] - rhs[0])) + ((_e[1] - rhs[1]) * (_e[1] - rhs[1])) + ((_e[2] - rhs[2]) * (_e[2] - rhs[2])));
+			return std::sqrt( ((_e[0] - rhs[0]) * (_e[0] - rhs[0])) + ((_e[1] - rhs[1]) * (_e[1] - rhs[1])) + ((_e[2] - rhs[2]) * (_e[2] - rhs[2])));
 		}
 
-		inline Vec3 UnitVector() const
+		inline Vec3Scalar UnitVector() const
 		{
 			return *this / this->Length();
 		}
 
-		static inline Vec3 UnitVector(Vec3 v)
+		static inline Vec3Scalar UnitVector(Vec3Scalar v)
 		{
 			return v / v.Length();
 		}
 
+		//Multiplies by one over the length rather than dividing each component, can be an ulp or so off UnitVector
+		inline Vec3Scalar FastUnitVector() const
+		{
+			return *this * (T(1) / this->Length());
+		}
+
+		static inline Vec3Scalar FastUnitVector(Vec3Scalar v)
+		{
+			return v.FastUnitVector();
+		}
+
 		inline void MakeUnitVector()
 		{
-			double k = 1.0 / this->Length();
+			T k = T(1) / this->Length();
 			_e[0] *= k;
 			_e[1] *= k;
 			_e[2] *= k;
 		}
 
+		//Per component min and max, same as calling dMin and dMax on each
+		static inline Vec3Scalar Min(const Vec3Scalar& a, const Vec3Scalar& b)
+		{
+			return Vec3Scalar(a.X() < b.X() ? a.X() : b.X(), a.Y() < b.Y() ? a.Y() : b.Y(), a.Z() < b.Z() ? a.Z() : b.Z());
+		}
+
+		static inline Vec3Scalar Max(const Vec3Scalar& a, const Vec3Scalar& b)
+		{
+			return Vec3Scalar(a.X() > b.X() ? a.X() : b.X(), a.Y() > b.Y() ? a.Y() : b.Y(), a.Z() > b.Z() ? a.Z() : b.Z());
+		}
+
 		inline sf::Color Vec3ToCol() const
 		{
 			return sf::Color(_e[0] * 255.0, _e[1] * 255.0, _e[2] * 255.0, 255.0);
@@ -191,187 +229,219 @@ namespace AA
 		}
 
 	private:
-		double _e[3];
+		T _e[3];
 	};
 
-	inline Vec3 operator * (const double& lh, const Vec3& rh)
+	template<typename T>
+	inline Vec3Scalar<T> operator * (const typename Vec3Scalar<T>::Scalar& lh, const Vec3Scalar<T>& rh)
 	{
-		return Vec3(lh * rh.X(), lh * rh.Y(), lh * rh.Z());
+		return Vec3Scalar<T>(lh * rh.X(), lh * rh.Y(), lh * rh.Z());
 	}
-	inline Vec3 operator / (const double& lh, const Vec3& rh)
+	template<typename T>
+	inline Vec3Scalar<T> operator / (const typename Vec3Scalar<T>::Scalar& lh, const Vec3Scalar<T>& rh)
 	{
-		return Vec3(lh / rh.X(), lh / rh.Y(), lh / rh.Z());
+		return Vec3Scalar<T>(lh / rh.X(), lh / rh.Y(), lh / rh.Z());
 	}
 
-	inline Vec3 operator - (const double& lh, const Vec3& rh)
+	template<typename T>
+	inline Vec3Scalar<T> operator - (const typename Vec3Scalar<T>::Scalar& lh, const Vec3Scalar<T>& rh)
 	{
-		return Vec3(lh - rh.X(), lh - rh.Y(), lh - rh.Z());
+		return Vec3Scalar<T>(lh - rh.X(), lh - rh.Y(), lh - rh.Z());
 	}
 
-	inline Vec3 operator + (const double& lh, const Vec3& rh)
+	template<typename T>
+	inline Vec3Scalar<T> operator + (const typename Vec3Scalar<T>::Scalar& lh, const Vec3Scalar<T>& rh)
 	{
-		return Vec3(lh + rh.X(), lh + rh.Y(), lh + rh.Z());
+		return Vec3Scalar<T>(lh + rh.X(), lh + rh.Y(), lh + rh.Z());
 	}
 
-	class Vec2
+	//Vec3Simd for float and double unless AA_SCALAR_VEC3 is defined, both give the same results so it is only there to compare against
+	template<typename T>
+	struct Vec3Backend
+	{
+		typedef Vec3Scalar<T> Type;
+	};
+#ifndef AA_SCALAR_VEC3
+	template<>
+	struct Vec3Backend<double>
+	{
+		typedef Vec3Simd<double> Type;
+	};
+	template<>
+	struct Vec3Backend<float>
+	{
+		typedef Vec3Simd<float> Type;
+	};
+#endif
+	template<typename T>
+	using Vec3T = typename Vec3Backend<T>::Type;
+
+	template<typename T>
+	class Vec2T
 	{
 	public:
-		Vec2()
+		typedef T Scalar;
+
+		Vec2T()
 		{
 			_e[0] = 0;
 			_e[1] = 0;
 		}
-		Vec2(const double& x, const double& y)
+		Vec2T(const T& x, const T& y)
 		{
 			_e[0] = x;
 			_e[1] = y;
 		}
 
 		//Accessors
-		inline double X() const { return _e[0]; }
-		inline double Y() const { return _e[1]; }
-		inline double operator[](int i) const { return _e[i]; }
-		inline double& operator[](int i) { return _e[i]; }
+		inline T X() const { return _e[0]; }
+		inline T Y() const { return _e[1]; }
+		inline T operator[](int i) const { return _e[i]; }
+		inline T& operator[](int i) { return _e[i]; }
 
 		//Operators
-		inline Vec2 operator + (const Vec2& rh) const
+		inline Vec2T operator + (const Vec2T& rh) const
 		{
-			return Vec2(_e[0] + rh.X(), _e[1] + rh.Y());
+			return Vec2T(_e[0] + rh.X(), _e[1] + rh.Y());
 		}
 
-		inline Vec2 operator - (const Vec2& rh) const
+		inline Vec2T operator - (const Vec2T& rh) const
 		{
-			return Vec2(_e[0] - rh.X(), _e[1] - rh.Y());
+			return Vec2T(_e[0] - rh.X(), _e[1] - rh.Y());
 		}
 
-		inline Vec2 operator / (const Vec2& rh) const
+		inline Vec2T operator / (const Vec2T& rh) const
 		{
-			return Vec2(_e[0] / rh.X(), _e[1] / rh.Y());
+			return Vec2T(_e[0] / rh.X(), _e[1] / rh.Y());
 		}
 
-		inline Vec2 operator / (const double& rh) const
+		inline Vec2T operator / (const T& rh) const
 		{
-			return Vec2(_e[0] / rh, _e[1] / rh);
+			return Vec2T(_e[0] / rh, _e[1] / rh);
 		}
 
-		inline Vec2 operator * (const Vec2& rh) const
+		inline Vec2T operator * (const Vec2T& rh) const
 		{
-			return Vec2(_e[0] * rh.X(), _e[1] * rh.Y());
+			return Vec2T(_e[0] * rh.X(), _e[1] * rh.Y());
 		}
 
-		inline Vec2 operator * (const double& rh) const
+		inline Vec2T operator * (const T& rh) const
 		{
-			return Vec2(_e[0] * rh, _e[1] * rh);
+			return Vec2T(_e[0] * rh, _e[1] * rh);
 		}
 
-		inline Vec2& operator -= (const Vec2& rh)
+		inline Vec2T& operator -= (const Vec2T& rh)
 		{
 			_e[0] -= rh.X();
 			_e[1] -= rh.Y();
 			return *this;
 		}
-		inline Vec2& operator += (const Vec2& rh)
+		inline Vec2T& operator += (const Vec2T& rh)
 		{
 			_e[0] += rh.X();
 			_e[1] += rh.Y();
 			return *this;
 		}
 
-		inline Vec2& operator += (const double& rh)
+		inline Vec2T& operator += (const T& rh)
 		{
 			_e[0] += rh;
 			_e[1] += rh;
 			return *this;
 		}
 
-		inline Vec2& operator *= (const Vec2& rh)
+		inline Vec2T& operator *= (const Vec2T& rh)
 		{
 			_e[0] *= rh.X();
 			_e[1] *= rh.Y();
 			return *this;
 		}
-		inline Vec2& operator *= (const double& rh)
+		inline Vec2T& operator *= (const T& rh)
 		{
 			_e[0] *= rh;
 			_e[1] *= rh;
 			return *this;
 		}
-		inline Vec2& operator /= (const Vec2& rh)
+		inline Vec2T& operator /= (const Vec2T& rh)
 		{
 			_e[0] /= rh.X();
 			_e[1] /= rh.Y();
 			return *this;
 		}
-		inline Vec2& operator /= (const double& rh)
+		inline Vec2T& operator /= (const T& rh)
 		{
 			_e[0] /= rh;
 			_e[1] /= rh;
 			return *this;
 		}
 
-		inline bool operator == (const Vec2& other) const
+		inline bool operator == (const Vec2T& other) const
 		{
 			return _e[0] == other.X() && _e[1] == other.Y();
 		}
 
-		inline bool operator != (const Vec2& other) const
+		inline bool operator != (const Vec2T& other) const
 		{
 			return _e[0] != other.X() && _e[1] != other.Y();
 		}
 
 		//Vector math functions
-		inline double DotProduct(const Vec2& b) const
+		inline T DotProduct(const Vec2T& b) const
 		{
 			return ((_e[0] * b.X()) + (_e[1] * b.Y()));
 		}
 
-		inline double Length() const
+		inline T Length() const
 		{
-			return sqrt(_e[0] * _e[0] + _e[1] * _e[1]);
+			return std::sqrt(_e[0] * _e[0] + _e[1] * _e[1]);
 		}
 
-		inline double SqrLength() const
+		inline T SqrLength() const
 		{
 			return _e[0] * _e[0] + _e[1] * _e[1];
 		}
 
-		inline Vec2 UnitVector() const
+		inline Vec2T UnitVector() const
 		{
 			return *this / this->Length();
 		}
 
 		inline void MakeUnitVector()
 		{
-			double k = 1.0 / this->Length();
+			T k = T(1) / this->Length();
 			_e[0] *= k;
 			_e[1] *= k;
 		}
 
 	private:
-		double _e[2];
+		T _e[2];
 	};
 
-	class Ray
+	template<typename T>
+	class RayT
 	{
 	public:
-		Vec3 _startPos;
-		Vec3 _dir;
-		Vec3 _inverseDir;
+		Vec3T<T> _startPos;
+		Vec3T<T> _dir;
+		Vec3T<T> _inverseDir;
 		int _signs[3];
-		Ray(const Vec3& startPos, const Vec3& dir) : _startPos(startPos), _dir(dir)
+		RayT(const Vec3T<T>& startPos, const Vec3T<T>& dir) : _startPos(startPos), _dir(dir)
 		{
-			_inverseDir[0] = 1 / dir.X();
-			_inverseDir[1] = 1 / dir.Y();
-			_inverseDir[2] = 1 / dir.Z();
+			_inverseDir = T(1) / dir;
 
 			_signs[0] = (_inverseDir.X() < 0);
 			_signs[1] = (_inverseDir.Y() < 0);
 			_signs[2] = (_inverseDir.Z() < 0);
 		}
-		~Ray() = default;
-		inline Vec3 GetPointAlongRay(double t) const { return _startPos + _dir * t; }
+		~RayT() = default;
+		inline Vec3T<T> GetPointAlongRay(T t) const { return _startPos + _dir * t; }
 	};
 
+	//Names the rest of the tracer uses, all running at the precision picked above
+	typedef Vec3T<Real> Vec3;
+	typedef Vec2T<Real> Vec2;
+	typedef RayT<Real> Ray;
+
 	class Vertex
 	{
 	public:
@@ -455,13 +525,15 @@ namespace AA
 
 
 	//Quicker fMin due to not needing to check for NaNs and other exceptions
-	static double dMin(double a, double b)
+	template<typename T>
+	static T dMin(T a, T b)
 	{
 		return a < b ? a : b;
 	}
 
 	//Quicker fMax due to not needing to check for NaNs and other exceptions
-	static double dMax(double a, double b)
+	template<typename T>
+	static T dMax(T a, T b)
 	{
 		return a > b ? a : b;
 	}
@@ -559,20 +631,28 @@ namespace AA
 }
 
 //Hash for Vec2
-template<> struct std::hash<AA::Vec2>
+template<typename T> struct std::hash<AA::Vec2T<T>>
 {
-	size_t operator()(AA::Vec2 const& vec) const
+	size_t operator()(AA::Vec2T<T> const& vec) const
 	{
-		return ( (std::hash<double>()(vec.X()) ^ (std::hash<double>()(vec.Y()) << 1)) );
+		return ( (std::hash<T>()(vec.X()) ^ (std::hash<T>()(vec.Y()) << 1)) );
 	}
 };
 
 //Hash for Vec3
-template<> struct std::hash<AA::Vec3>
+template<typename T> struct std::hash<AA::Vec3Scalar<T>>
+{
+	size_t operator()(AA::Vec3Scalar<T> const& vec) const
+	{
+		return ((std::hash<T>()(vec.X()) ^ (std::hash<T>()(vec.Y()) << 1)) >> 1) ^ (std::hash<T>()(vec.Z()) << 1);
+	}
+};
+
+template<typename T> struct std::hash<AA::Vec3Simd<T>>
 {
-	size_t operator()(AA::Vec3 const& vec) const
+	size_t operator()(AA::Vec3Simd<T> const& vec) const
 	{
-		return ((std::hash<double>()(vec.X()) ^ (std::hash<double>()(vec.Y()) << 1)) >> 1) ^ (std::hash<double>()(vec.Z()) << 1);
+		return ((std::hash<T>()(vec.X()) ^ (std::hash<T>()(vec.Y()) << 1)) >> 1) ^ (std::hash<T>()(vec.Z()) << 1);
 	}
 };
 
@@ -0,0 +1,390 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <emmintrin.h>
+#include <SFML/Graphics.hpp>
+
+namespace AA
+{
+	//SSE versions of Vec3Scalar with the same interface, Vec3T picks these unless AA_SCALAR_VEC3 is defined
+	//Every lane does the same operation in the same order as the scalar version so results match it bit for bit, apart from FastUnitVector
+	//Padded out to four lanes, the last one is kept at zero and never read
+	template<typename T>
+	class Vec3Simd;
+
+	template<>
+	class Vec3Simd<double>
+	{
+	public:
+		typedef double Scalar;
+
+		Vec3Simd()
+		{
+			_v[0] = _mm_setzero_pd();
+			_v[1] = _mm_setzero_pd();
+		}
+		Vec3Simd(const double& x, const double& y, const double& z)
+		{
+			_v[0] = _mm_set_pd(y, x);
+			_v[1] = _mm_set_sd(z);
+		}
+		//xy in one register, z and the padding in the other
+		Vec3Simd(__m128d xy, __m128d zw)
+		{
+			_v[0] = xy;
+			_v[1] = zw;
+		}
+
+		//Accessors
+		inline double X() const { return _e[0]; }
+		inline double Y() const { return _e[1]; }
+		inline double Z() const { return _e[2]; }
+		inline double R() const { return _e[0]; }
+		inline double G() const { return _e[1]; }
+		inline double B() const { return _e[2]; }
+		inline double operator[](int i) const { return _e[i]; }
+		inline double& operator[](int i) { return _e[i]; }
+		inline __m128d XY() const { return _v[0]; }
+		inline __m128d ZW() const { return _v[1]; }
+
+		//Operators, the _sd forms only touch z so the padding lane stays zero
+		inline Vec3Simd operator + (const Vec3Simd& rh) const
+		{
+			return Vec3Simd(_mm_add_pd(_v[0], rh._v[0]), _mm_add_sd(_v[1], rh._v[1]));
+		}
+
+		inline Vec3Simd operator - (const Vec3Simd& rh) const
+		{
+			return Vec3Simd(_mm_sub_pd(_v[0], rh._v[0]), _mm_sub_sd(_v[1], rh._v[1]));
+		}
+
+		inline Vec3Simd operator / (const Vec3Simd& rh) const
+		{
+			return Vec3Simd(_mm_div_pd(_v[0], rh._v[0]), _mm_div_sd(_v[1], rh._v[1]));
+		}
+
+		inline Vec3Simd operator / (const double& rh) const
+		{
+			__m128d s = _mm_set1_pd(rh);
+			return Vec3Simd(_mm_div_pd(_v[0], s), _mm_div_sd(_v[1], s));
+		}
+
+		inline Vec3Simd operator * (const Vec3Simd& rh) const
+		{
+			return Vec3Simd(_mm_mul_pd(_v[0], rh._v[0]), _mm_mul_sd(_v[1], rh._v[1]));
+		}
+
+		inline Vec3Simd operator * (const double& rh) const
+		{
+			__m128d s = _mm_set1_pd(rh);
+			return Vec3Simd(_mm_mul_pd(_v[0], s), _mm_mul_sd(_v[1], s));
+		}
+
+		inline Vec3Simd& operator -= (const Vec3Simd& rh) { return *this = *this - rh; }
+		inline Vec3Simd& operator += (const Vec3Simd& rh) { return *this = *this + rh; }
+
+		inline Vec3Simd& operator += (const double& rh)
+		{
+			__m128d s = _mm_set1_pd(rh);
+			_v[0] = _mm_add_pd(_v[0], s);
+			_v[1] = _mm_add_sd(_v[1], s);
+			return *this;
+		}
+
+		inline Vec3Simd& operator *= (const Vec3Simd& rh) { return *this = *this * rh; }
+		inline Vec3Simd& operator *= (const double& rh) { return *this = *this * rh; }
+		inline Vec3Simd& operator /= (const Vec3Simd& rh) { return *this = *this / rh; }
+		inline Vec3Simd& operator /= (const double& rh) { return *this = *this / rh; }
+
+		inline bool operator == (const Vec3Simd& other) const
+		{
+			return _mm_movemask_pd(_mm_cmpeq_pd(_v[0], other._v[0])) == 3 && (_mm_movemask_pd(_mm_cmpeq_sd(_v[1], other._v[1])) & 1);
+		}
+
+		//Same as the scalar version, only true when every component differs
+		inline bool operator != (const Vec3Simd& other) const
+		{
+			return _mm_movemask_pd(_mm_cmpneq_pd(_v[0], other._v[0])) == 3 && (_mm_movemask_pd(_mm_cmpneq_sd(_v[1], other._v[1])) & 1);
+		}
+
+		//Vector math functions
+		inline double DotProduct(const Vec3Simd& b) const
+		{
+			//(x + y) + z like the scalar version
+			__m128d xy = _mm_mul_pd(_v[0], b._v[0]);
+			__m128d sum = _mm_add_sd(xy, _mm_unpackhi_pd(xy, xy));
+			return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_mul_sd(_v[1], b._v[1])));
+		}
+
+		inline Vec3Simd CrossProduct(const Vec3Simd& b) const
+		{
+			__m128d aYZ = _mm_shuffle_pd(_v[0], _v[1], 1);
+			__m128d aZX = _mm_shuffle_pd(_v[1], _v[0], 0);
+			__m128d bYZ = _mm_shuffle_pd(b._v[0], b._v[1], 1);
+			__m128d bZX = _mm_shuffle_pd(b._v[1], b._v[0], 0);
+			__m128d xy = _mm_sub_pd(_mm_mul_pd(aYZ, bZX), _mm_mul_pd(aZX, bYZ));
+
+			//a.x * b.y and a.y * b.x side by side, then take one from the other
+			__m128d zTerms = _mm_mul_pd(_v[0], _mm_shuffle_pd(b._v[0], b._v[0], 1));
+			__m128d z = _mm_sub_sd(zTerms, _mm_unpackhi_pd(zTerms, zTerms));
+			return Vec3Simd(xy, _mm_move_sd(_mm_setzero_pd(), z));
+		}
+
+		inline double Length() const
+		{
+			return std::sqrt(SqrLength());
+		}
+
+		inline double SqrLength() const
+		{
+			return DotProduct(*this);
+		}
+
+		inline double Distance(Vec3Simd rhs)
+		{
+			return (*this - rhs).Length();
+		}
+
+		inline Vec3Simd UnitVector() const
+		{
+			return *this / this->Length();
+		}
+
+		static inline Vec3Simd UnitVector(Vec3Simd v)
+		{
+			return v / v.Length();
+		}
+
+		//One square root and divide then a multiply across the lanes rather than dividing each one, can be an ulp or so off UnitVector
+		inline Vec3Simd FastUnitVector() const
+		{
+			return *this * (1.0 / this->Length());
+		}
+
+		static inline Vec3Simd FastUnitVector(Vec3Simd v)
+		{
+			return v.FastUnitVector();
+		}
+
+		inline void MakeUnitVector()
+		{
+			double k = 1.0 / this->Length();
+			*this *= k;
+		}
+
+		//Per component min and max, picking the same side dMin and dMax do
+		static inline Vec3Simd Min(const Vec3Simd& a, const Vec3Simd& b)
+		{
+			return Vec3Simd(_mm_min_pd(a._v[0], b._v[0]), _mm_min_pd(a._v[1], b._v[1]));
+		}
+
+		static inline Vec3Simd Max(const Vec3Simd& a, const Vec3Simd& b)
+		{
+			return Vec3Simd(_mm_max_pd(a._v[0], b._v[0]), _mm_max_pd(a._v[1], b._v[1]));
+		}
+
+		inline sf::Color Vec3ToCol() const
+		{
+			return sf::Color(_e[0] * 255.0, _e[1] * 255.0, _e[2] * 255.0, 255.0);
+		}
+
+		inline bool IsNAN() const
+		{
+			return _e[0] != _e[0] || _e[1] != _e[1] || _e[2] != _e[2];
+		}
+
+	private:
+		union
+		{
+			__m128d _v[2];
+			double _e[4];
+		};
+	};
+
+	inline Vec3Simd<double> operator * (const double& lh, const Vec3Simd<double>& rh)
+	{
+		__m128d s = _mm_set1_pd(lh);
+		return Vec3Simd<double>(_mm_mul_pd(s, rh.XY()), _mm_mul_sd(_mm_set_sd(lh), rh.ZW()));
+	}
+
+	inline Vec3Simd<double> operator / (const double& lh, const Vec3Simd<double>& rh)
+	{
+		__m128d s = _mm_set1_pd(lh);
+		return Vec3Simd<double>(_mm_div_pd(s, rh.XY()), _mm_div_sd(_mm_set_sd(lh), rh.ZW()));
+	}
+
+	inline Vec3Simd<double> operator - (const double& lh, const Vec3Simd<double>& rh)
+	{
+		__m128d s = _mm_set1_pd(lh);
+		return Vec3Simd<double>(_mm_sub_pd(s, rh.XY()), _mm_sub_sd(_mm_set_sd(lh), rh.ZW()));
+	}
+
+	inline Vec3Simd<double> operator + (const double& lh, const Vec3Simd<double>& rh)
+	{
+		__m128d s = _mm_set1_pd(lh);
+		return Vec3Simd<double>(_mm_add_pd(s, rh.XY()), _mm_add_sd(_mm_set_sd(lh), rh.ZW()));
+	}
+
+	template<>
+	class Vec3Simd<float>
+	{
+	public:
+		typedef float Scalar;
+
+		Vec3Simd() : _v(_mm_setzero_ps()) { }
+		Vec3Simd(const float& x, const float& y, const float& z) : _v(_mm_set_ps(0.0f, z, y, x)) { }
+		explicit Vec3Simd(__m128 xyzw) : _v(xyzw) { }
+
+		//Accessors
+		inline float X() const { return _e[0]; }
+		inline float Y() const { return _e[1]; }
+		inline float Z() const { return _e[2]; }
+		inline float R() const { return _e[0]; }
+		inline float G() const { return _e[1]; }
+		inline float B() const { return _e[2]; }
+		inline float operator[](int i) const { return _e[i]; }
+		inline float& operator[](int i) { return _e[i]; }
+		inline __m128 XYZW() const { return _v; }
+
+		//Operators
+		inline Vec3Simd operator + (const Vec3Simd& rh) const { return Vec3Simd(_mm_add_ps(_v, rh._v)); }
+		inline Vec3Simd operator - (const Vec3Simd& rh) const { return Vec3Simd(_mm_sub_ps(_v, rh._v)); }
+		inline Vec3Simd operator / (const Vec3Simd& rh) const { return Vec3Simd(ClearW(_mm_div_ps(_v, rh._v))); }
+		inline Vec3Simd operator / (const float& rh) const { return Vec3Simd(_mm_div_ps(_v, _mm_set1_ps(rh))); }
+		inline Vec3Simd operator * (const Vec3Simd& rh) const { return Vec3Simd(_mm_mul_ps(_v, rh._v)); }
+		inline Vec3Simd operator * (const float& rh) const { return Vec3Simd(_mm_mul_ps(_v, _mm_set1_ps(rh))); }
+
+		inline Vec3Simd& operator -= (const Vec3Simd& rh) { return *this = *this - rh; }
+		inline Vec3Simd& operator += (const Vec3Simd& rh) { return *this = *this + rh; }
+		inline Vec3Simd& operator += (const float& rh) { return *this = Vec3Simd(ClearW(_mm_add_ps(_v, _mm_set1_ps(rh)))); }
+		inline Vec3Simd& operator *= (const Vec3Simd& rh) { return *this = *this * rh; }
+		inline Vec3Simd& operator *= (const float& rh) { return *this = *this * rh; }
+		inline Vec3Simd& operator /= (const Vec3Simd& rh) { return *this = *this / rh; }
+		inline Vec3Simd& operator /= (const float& rh) { return *this = *this / rh; }
+
+		inline bool operator == (const Vec3Simd& other) const
+		{
+			return (_mm_movemask_ps(_mm_cmpeq_ps(_v, other._v)) & 7) == 7;
+		}
+
+		//Same as the scalar version, only true when every component differs
+		inline bool operator != (const Vec3Simd& other) const
+		{
+			return (_mm_movemask_ps(_mm_cmpneq_ps(_v, other._v)) & 7) == 7;
+		}
+
+		//Vector math functions
+		inline float DotProduct(const Vec3Simd& b) const
+		{
+			//(x + y) + z like the scalar version
+			__m128 products = _mm_mul_ps(_v, b._v);
+			__m128 sum = _mm_add_ss(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 1, 1, 1)));
+			return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 2, 2, 2))));
+		}
+
+		inline Vec3Simd CrossProduct(const Vec3Simd& b) const
+		{
+			__m128 aYZX = _mm_shuffle_ps(_v, _v, _MM_SHUFFLE(3, 0, 2, 1));
+			__m128 aZXY = _mm_shuffle_ps(_v, _v, _MM_SHUFFLE(3, 1, 0, 2));
+			__m128 bYZX = _mm_shuffle_ps(b._v, b._v, _MM_SHUFFLE(3, 0, 2, 1));
+			__m128 bZXY = _mm_shuffle_ps(b._v, b._v, _MM_SHUFFLE(3, 1, 0, 2));
+			return Vec3Simd(_mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX)));
+		}
+
+		inline float Length() const
+		{
+			return std::sqrt(SqrLength());
+		}
+
+		inline float SqrLength() const
+		{
+			return DotProduct(*this);
+		}
+
+		inline float Distance(Vec3Simd rhs)
+		{
+			return (*this - rhs).Length();
+		}
+
+		inline Vec3Simd UnitVector() const
+		{
+			return *this / this->Length();
+		}
+
+		static inline Vec3Simd UnitVector(Vec3Simd v)
+		{
+			return v / v.Length();
+		}
+
+		//Hardware reciprocal square root with a Newton step instead of a square root and divide, good to around 1e-6 of UnitVector
+		inline Vec3Simd FastUnitVector() const
+		{
+			__m128 sqrLength = _mm_set1_ps(SqrLength());
+			__m128 estimate = _mm_rsqrt_ps(sqrLength);
+			__m128 refined = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), estimate), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_mul_ps(sqrLength, estimate), estimate)));
+			return Vec3Simd(_mm_mul_ps(_v, refined));
+		}
+
+		static inline Vec3Simd FastUnitVector(Vec3Simd v)
+		{
+			return v.FastUnitVector();
+		}
+
+		inline void MakeUnitVector()
+		{
+			float k = 1.0f / this->Length();
+			*this *= k;
+		}
+
+		//Per component min and max, picking the same side dMin and dMax do
+		static inline Vec3Simd Min(const Vec3Simd& a, const Vec3Simd& b) { return Vec3Simd(_mm_min_ps(a._v, b._v)); }
+		static inline Vec3Simd Max(const Vec3Simd& a, const Vec3Simd& b) { return Vec3Simd(_mm_max_ps(a._v, b._v)); }
+
+		inline sf::Color Vec3ToCol() const
+		{
+			return sf::Color(_e[0] * 255.0, _e[1] * 255.0, _e[2] * 255.0, 255.0);
+		}
+
+		inline bool IsNAN() const
+		{
+			return _e[0] != _e[0] || _e[1] != _e[1] || _e[2] != _e[2];
+		}
+
+		//Zeroes the padding lane after anything that could leave a NaN or infinity in it
+		static inline __m128 ClearW(__m128 v)
+		{
+			return _mm_and_ps(v, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+		}
+
+	private:
+		union
+		{
+			__m128 _v;
+			float _e[4];
+		};
+	};
+
+	inline Vec3Simd<float> operator * (const float& lh, const Vec3Simd<float>& rh)
+	{
+		return Vec3Simd<float>(_mm_mul_ps(_mm_set1_ps(lh), rh.XYZW()));
+	}
+
+	inline Vec3Simd<float> operator / (const float& lh, const Vec3Simd<float>& rh)
+	{
+		return Vec3Simd<float>(Vec3Simd<float>::ClearW(_mm_div_ps(_mm_set1_ps(lh), rh.XYZW())));
+	}
+
+	inline Vec3Simd<float> operator - (const float& lh, const Vec3Simd<float>& rh)
+	{
+		return Vec3Simd<float>(Vec3Simd<float>::ClearW(_mm_sub_ps(_mm_set1_ps(lh), rh.XYZW())));
+	}
+
+	inline Vec3Simd<float> operator + (const float& lh, const Vec3Simd<float>& rh)
+	{
+		return Vec3Simd<float>(Vec3Simd<float>::ClearW(_mm_add_ps(_mm_set1_ps(lh), rh.XYZW())));
+	}
+
+	//Runs both versions of every Vec3 operation over random inputs and prints any that disagree by more than tolerance, relative to the scalar result
+	//Zero tolerance means bit for bit, FastUnitVector is always allowed the error its comment gives. Returns true when everything matched
+	bool CompareVec3Backends(uint32_t samples, double tolerance);
+}
@@ -0,0 +1,368 @@
+#pragma once
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include "Utilities.h"
+
+class LinearBvh;
+
+//Four wide BVH collapsed from a built LinearBvh, each node holds the boxes of up to four children side by side so one ray is tested against all of them at once with SSE
+//Bounds are stored as floats rounded outwards so they never shrink compared to the double precision tree they came from
+//Big trees can swap to quantised nodes half the size, worth the looser boxes once the float nodes stop fitting in cache
+class WideBvh
+{
+public:
+	static const int kWidth = 4;
+
+	struct alignas(16) Node
+	{
+		float minX[kWidth];
+		float minY[kWidth];
+		float minZ[kWidth];
+		float maxX[kWidth];
+		float maxY[kWidth];
+		float maxZ[kWidth];
+
+		//Leaf: index of the first primitive in the primitive index array, Interior: index of the child node
+		uint32_t child[kWidth];
+
+		//Amount of primitives in a leaf child, zero marks an interior child or an empty slot
+		uint32_t primCount[kWidth];
+	};
+
+	//Children stored as 8 bit steps across the node's own bounds, a step is a power of two so decoding is exact and every box only grows
+	//64 bytes so a node is a single cache line wherever the allocator lines them up, the float node takes two
+	struct alignas(64) QuantisedNode
+	{
+		//Corner the steps count up from and the power of two size of a step along each axis
+		float origin[3];
+		int8_t exponent[3];
+
+		//Bit per slot in use, unused slots can't be parked at infinity like the float node does
+		uint8_t slotMask;
+
+		uint8_t minX[kWidth];
+		uint8_t minY[kWidth];
+		uint8_t minZ[kWidth];
+		uint8_t maxX[kWidth];
+		uint8_t maxY[kWidth];
+		uint8_t maxZ[kWidth];
+
+		uint32_t child[kWidth];
+		uint8_t primCount[kWidth];
+	};
+
+	WideBvh() = default;
+	~WideBvh() = default;
+
+	//Collapses the binary tree by repeatedly opening up the child with the largest surface area until a node has four children
+	//Quantised falls back to float nodes when some box is too big to be stepped across in 8 bits
+	void Build(const LinearBvh& bvh, bool quantised = false);
+	void Clear();
+
+	//Same contract as LinearBvh::Traverse, children are visited nearest first and anything starting past the closest hit so far is skipped
+	template<typename PrimFunc>
+	inline bool Traverse(const AA::Ray& ray, double t_min, double t_max, PrimFunc intersectPrim) const
+	{
+		return TraverseLeaves(ray, t_min, t_max, [&intersectPrim](const uint32_t* primIndices, uint32_t primCount, double& closestHit)
+		{
+			bool didHit = false;
+			for (uint32_t i = 0; i < primCount; ++i)
+			{
+				didHit |= intersectPrim(primIndices[i], closestHit);
+			}
+			return didHit;
+		});
+	}
+
+	//Hands over a whole leaf at a time as bool(const uint32_t* primIndices, uint32_t primCount, double& closestHit) so it can be tested in one batch
+	template<typename LeafFunc>
+	inline bool TraverseLeaves(const AA::Ray& ray, double t_min, double t_max, LeafFunc intersectLeaf) const
+	{
+		return IsQuantised() ? TraverseNodes(_quantisedNodes, ray, t_min, t_max, intersectLeaf) : TraverseNodes(_nodes, ray, t_min, t_max, intersectLeaf);
+	}
+
+	//Any hit version for shadow rays, the callback is bool(uint32_t primIndex) and the walk stops at the first primitive it says blocks the ray
+	//Nothing is sorted since any hit will do and the range never shrinks
+	template<typename PrimFunc>
+	inline bool TraverseAny(const AA::Ray& ray, double t_min, double t_max, PrimFunc occludedPrim) const
+	{
+		return TraverseAnyLeaves(ray, t_min, t_max, [&occludedPrim](const uint32_t* primIndices, uint32_t primCount)
+		{
+			for (uint32_t i = 0; i < primCount; ++i)
+			{
+				if (occludedPrim(primIndices[i]))
+				{
+					return true;
+				}
+			}
+			return false;
+		});
+	}
+
+	//Leaf at a time version of TraverseAny, the callback is bool(const uint32_t* primIndices, uint32_t primCount)
+	template<typename LeafFunc>
+	inline bool TraverseAnyLeaves(const AA::Ray& ray, double t_min, double t_max, LeafFunc occludedLeaf) const
+	{
+		return IsQuantised() ? TraverseAnyNodes(_quantisedNodes, ray, t_min, t_max, occludedLeaf) : TraverseAnyNodes(_nodes, ray, t_min, t_max, occludedLeaf);
+	}
+
+	inline bool IsConstructed() const { return !_nodes.empty() || !_quantisedNodes.empty(); }
+	inline bool IsQuantised() const { return !_quantisedNodes.empty(); }
+
+	//Only one of these is filled, whichever format the last build used
+	inline const std::vector<Node>& GetNodes() const { return _nodes; }
+	inline const std::vector<QuantisedNode>& GetQuantisedNodes() const { return _quantisedNodes; }
+
+	//Primitive indices in the order the leaves sit in the node array
+	inline const std::vector<uint32_t>& GetPrimIndices() const { return _primIndices; }
+
+	//Every visited node can push three more entries than it pops, the builders never go past 64 levels
+	static const int kMaxStackSize = 64 * (kWidth - 1) + 1;
+
+private:
+	struct StackEntry
+	{
+		uint32_t child;
+		uint32_t primCount;
+
+		//Where the ray entered this child's box, by the time it's popped a closer hit may already rule it out
+		float tNear;
+	};
+
+	//Ray constants splatted across the four lanes, built once per traversal
+	struct RayLanes
+	{
+		__m128 originX, originY, originZ;
+		__m128 invDirX, invDirY, invDirZ;
+		__m128 rayMin;
+	};
+
+	static inline RayLanes MakeRayLanes(const AA::Ray& ray, double t_min);
+
+	//Slab test against all four children at once, returns a mask of the hit slots. Empty slots sit at infinity and never pass
+	static inline int IntersectChildren(const Node& node, const RayLanes& lanes, __m128 rayMax, __m128& outNear);
+
+	//Decodes the children's boxes then runs the same slab test, only the slots in use can pass
+	static inline int IntersectChildren(const QuantisedNode& node, const RayLanes& lanes, __m128 rayMax, __m128& outNear);
+	static inline int IntersectSlabs(__m128 minX, __m128 minY, __m128 minZ, __m128 maxX, __m128 maxY, __m128 maxZ, const RayLanes& lanes, __m128 rayMax, __m128& outNear);
+
+	//Four 8 bit steps widened to floats and scaled out from the origin, the scale is a power of two so only the add rounds
+	static inline __m128 DecodeSteps(const uint8_t* steps, __m128 origin, __m128 scale);
+	static inline float StepScale(int8_t exponent);
+
+	template<typename NodeType, typename LeafFunc>
+	bool TraverseNodes(const std::vector<NodeType>& nodes, const AA::Ray& ray, double t_min, double t_max, LeafFunc intersectLeaf) const;
+
+	template<typename NodeType, typename LeafFunc>
+	bool TraverseAnyNodes(const std::vector<NodeType>& nodes, const AA::Ray& ray, double t_min, double t_max, LeafFunc occludedLeaf) const;
+
+	//Capped below infinity so the empty slots parked at infinity can't pass the test on an unbounded ray
+	static inline float CapRayMax(double t_max) { return static_cast<float>(t_max < FLT_MAX ? t_max : FLT_MAX); }
+
+	uint32_t CollapseNode(const LinearBvh& bvh, uint32_t binaryIndex);
+	void SetChild(uint32_t nodeIndex, int slot, const LinearBvh& bvh, uint32_t binaryIndex);
+
+	//Swaps the float nodes for quantised ones, leaves the float nodes alone and returns false if any node can't be quantised
+	bool Quantise();
+	static bool QuantiseNode(const Node& node, QuantisedNode& outNode);
+
+	std::vector<Node> _nodes;
+	std::vector<QuantisedNode> _quantisedNodes;
+	std::vector<uint32_t> _primIndices;
+};
+
+inline WideBvh::RayLanes WideBvh::MakeRayLanes(const AA::Ray& ray, double t_min)
+{
+	RayLanes lanes;
+	lanes.originX = _mm_set1_ps(static_cast<float>(ray._startPos.X()));
+	lanes.originY = _mm_set1_ps(static_cast<float>(ray._startPos.Y()));
+	lanes.originZ = _mm_set1_ps(static_cast<float>(ray._startPos.Z()));
+	lanes.invDirX = _mm_set1_ps(static_cast<float>(ray._inverseDir.X()));
+	lanes.invDirY = _mm_set1_ps(static_cast<float>(ray._inverseDir.Y()));
+	lanes.invDirZ = _mm_set1_ps(static_cast<float>(ray._inverseDir.Z()));
+	lanes.rayMin = _mm_set1_ps(static_cast<float>(t_min));
+	return lanes;
+}
+
+inline int WideBvh::IntersectChildren(const Node& node, const RayLanes& lanes, __m128 rayMax, __m128& outNear)
+{
+	return IntersectSlabs(_mm_load_ps(node.minX), _mm_load_ps(node.minY), _mm_load_ps(node.minZ), _mm_load_ps(node.maxX), _mm_load_ps(node.maxY), _mm_load_ps(node.maxZ), lanes, rayMax, outNear);
+}
+
+inline int WideBvh::IntersectChildren(const QuantisedNode& node, const RayLanes& lanes, __m128 rayMax, __m128& outNear)
+{
+	__m128 originX = _mm_set1_ps(node.origin[0]);
+	__m128 originY = _mm_set1_ps(node.origin[1]);
+	__m128 originZ = _mm_set1_ps(node.origin[2]);
+	__m128 scaleX = _mm_set1_ps(StepScale(node.exponent[0]));
+	__m128 scaleY = _mm_set1_ps(StepScale(node.exponent[1]));
+	__m128 scaleZ = _mm_set1_ps(StepScale(node.exponent[2]));
+
+	int hitMask = IntersectSlabs(
+		DecodeSteps(node.minX, originX, scaleX), DecodeSteps(node.minY, originY, scaleY), DecodeSteps(node.minZ, originZ, scaleZ),
+		DecodeSteps(node.maxX, originX, scaleX), DecodeSteps(node.maxY, originY, scaleY), DecodeSteps(node.maxZ, originZ, scaleZ),
+		lanes, rayMax, outNear);
+	return hitMask & node.slotMask;
+}
+
+inline int WideBvh::IntersectSlabs(__m128 minX, __m128 minY, __m128 minZ, __m128 maxX, __m128 maxY, __m128 maxZ, const RayLanes& lanes, __m128 rayMax, __m128& outNear)
+{
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(minX, lanes.originX), lanes.invDirX);
+	__m128 t2 = _mm_mul_ps(_mm_sub_ps(maxX, lanes.originX), lanes.invDirX);
+	__m128 tNear = _mm_max_ps(lanes.rayMin, _mm_min_ps(t1, t2));
+	__m128 tFar = _mm_min_ps(rayMax, _mm_max_ps(t1, t2));
+
+	t1 = _mm_mul_ps(_mm_sub_ps(minY, lanes.originY), lanes.invDirY);
+	t2 = _mm_mul_ps(_mm_sub_ps(maxY, lanes.originY), lanes.invDirY);
+	tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+	tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+
+	t1 = _mm_mul_ps(_mm_sub_ps(minZ, lanes.originZ), lanes.invDirZ);
+	t2 = _mm_mul_ps(_mm_sub_ps(maxZ, lanes.originZ), lanes.invDirZ);
+	tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+	tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+
+	outNear = tNear;
+	return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+}
+
+inline __m128 WideBvh::DecodeSteps(const uint8_t* steps, __m128 origin, __m128 scale)
+{
+	int packed;
+	std::memcpy(&packed, steps, sizeof(packed));
+	__m128i zero = _mm_setzero_si128();
+	__m128i widened = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+	return _mm_add_ps(origin, _mm_mul_ps(_mm_cvtepi32_ps(widened), scale));
+}
+
+inline float WideBvh::StepScale(int8_t exponent)
+{
+	//Builds 2^exponent straight from the float's bits, the builder keeps exponents inside the normal range
+	uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+	float scale;
+	std::memcpy(&scale, &bits, sizeof(scale));
+	return scale;
+}
+
+template<typename NodeType, typename LeafFunc>
+bool WideBvh::TraverseNodes(const std::vector<NodeType>& nodes, const AA::Ray& ray, double t_min, double t_max, LeafFunc intersectLeaf) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	const RayLanes lanes = MakeRayLanes(ray, t_min);
+	double closestHit = t_max;
+	float rayMaxScalar = CapRayMax(t_max);
+	__m128 rayMax = _mm_set1_ps(rayMaxScalar);
+
+	StackEntry stack[kMaxStackSize];
+	int stackSize = 0;
+	stack[stackSize++] = { 0, 0, 0.0f };
+	bool didHit = false;
+
+	while (stackSize > 0)
+	{
+		StackEntry entry = stack[--stackSize];
+		if (entry.tNear > rayMaxScalar)
+		{
+			continue;
+		}
+
+		if (entry.primCount > 0)
+		{
+			didHit |= intersectLeaf(&_primIndices[entry.child], entry.primCount, closestHit);
+
+			//Pull the far end of the box tests in to the closest hit, rounded up so a box touching that hit still passes
+			float closest = closestHit < FLT_MAX ? std::nextafter(static_cast<float>(closestHit), INFINITY) : FLT_MAX;
+			if (closest < rayMaxScalar)
+			{
+				rayMaxScalar = closest;
+				rayMax = _mm_set1_ps(rayMaxScalar);
+			}
+			continue;
+		}
+
+		const NodeType& node = nodes[entry.child];
+		__m128 tNear;
+		int hitMask = IntersectChildren(node, lanes, rayMax, tNear);
+		if (hitMask == 0)
+		{
+			continue;
+		}
+
+		alignas(16) float nearDists[kWidth];
+		_mm_store_ps(nearDists, tNear);
+
+		//Sort the hit children far to near so the nearest one ends up on top of the stack
+		int order[kWidth];
+		int hitCount = 0;
+		for (int slot = 0; slot < kWidth; ++slot)
+		{
+			if ((hitMask & (1 << slot)) == 0) { continue; }
+
+			int insert = hitCount++;
+			while (insert > 0 && nearDists[order[insert - 1]] < nearDists[slot])
+			{
+				order[insert] = order[insert - 1];
+				--insert;
+			}
+			order[insert] = slot;
+		}
+
+		for (int i = 0; i < hitCount; ++i)
+		{
+			stack[stackSize++] = { node.child[order[i]], node.primCount[order[i]], nearDists[order[i]] };
+		}
+	}
+
+	return didHit;
+}
+
+template<typename NodeType, typename LeafFunc>
+bool WideBvh::TraverseAnyNodes(const std::vector<NodeType>& nodes, const AA::Ray& ray, double t_min, double t_max, LeafFunc occludedLeaf) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	const RayLanes lanes = MakeRayLanes(ray, t_min);
+	const __m128 rayMax = _mm_set1_ps(CapRayMax(t_max));
+
+	StackEntry stack[kMaxStackSize];
+	int stackSize = 0;
+	stack[stackSize++] = { 0, 0, 0.0f };
+
+	while (stackSize > 0)
+	{
+		StackEntry entry = stack[--stackSize];
+		if (entry.primCount > 0)
+		{
+			if (occludedLeaf(&_primIndices[entry.child], entry.primCount))
+			{
+				return true;
+			}
+			continue;
+		}
+
+		const NodeType& node = nodes[entry.child];
+		__m128 tNear;
+		int hitMask = IntersectChildren(node, lanes, rayMax, tNear);
+		for (int slot = 0; slot < kWidth; ++slot)
+		{
+			if (hitMask & (1 << slot))
+			{
+				stack[stackSize++] = { node.child[slot], node.primCount[slot], 0.0f };
+			}
+		}
+	}
+
+	return false;
+}
@@ -1,6 +1,7 @@
 #include "..\include\AABB.h"
 
-bool AABB::IntersectedRay(const AA::Ray& ray, double tMin, double tMax)
+template<typename T>
+bool AABBT<T>::IntersectedRay(const AA::RayT<T>& ray, T tMin, T tMax) const
 {
 	// Using the slab method check if the ray is within each axis
 	//If all axis are within and it lies between tMin and tMax of the ray then WE GOOD, INTERSECTED
@@ -8,10 +9,10 @@ bool AABB::IntersectedRay(const AA::Ray& ray, double tMin, double tMax)
 	for (int i = 0; i < 3; i++)
 	{
 		//Lower side intersect
-		double t0 = (Min()[i] - ray._startPos[i]) * ray._inverseDir[i];
+		T t0 = (Min()[i] - ray._startPos[i]) * ray._inverseDir[i];
 
 		//Upper side intersect
-		double t1 = (Max()[i] - ray._startPos[i]) * ray._inverseDir[i];
+		T t1 = (Max()[i] - ray._startPos[i]) * ray._inverseDir[i];
 
 		//If the rays decening through box instead of ascending, switch t0 and t1 to keep following calcs correct
 		if (ray._inverseDir[i] < 0.0f)
@@ -31,3 +32,6 @@ bool AABB::IntersectedRay(const AA::Ray& ray, double tMin, double tMax)
 
 	return true;
 }
+
+template class AABBT<float>;
+template class AABBT<double>;
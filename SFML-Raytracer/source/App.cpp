@@ -1,7 +1,9 @@
 #include "..\include\App.h"
+#include <algorithm>
 #include <iostream>
 #include <random>
 #include <functional>
+#include <fstream>
 
 #include "Diffuse.h"
 #include "Mirror.h"
@@ -9,7 +11,7 @@
 //https://raytracing.github.io/books/RayTracingInOneWeekend.html up to antialisaing
 //https://github.com/RayTracing/raytracing.github.io
 
-App::App() : _calcsPerDivision((_width * _height) / _totalThreads), _totalPixels(_width * _height)
+App::App() : _totalPixels(_width * _height), _totalThreads(std::max(static_cast<int>(std::thread::hardware_concurrency()), 1))
 {
 }
 
@@ -41,12 +43,19 @@ void App::InitCoreSystems()
     view.setSize(_width, -_height);
     _pWindow->setView(view);
     _renderTexture = std::make_unique<sf::Texture>();
+    _renderTexture->create(_width, _height);
     _renderTarget = sf::RectangleShape(sf::Vector2f(_width, _height));
+    _renderTarget.setTexture(_renderTexture.get());
 
     //Raytracer related inits
+    if (_checkVec3Backends)
+    {
+        AA::CompareVec3Backends(100000, _vec3CheckTolerance);
+    }
+
     _pixelColourBuffer = std::make_unique<AA::ColourArray>(_width, _height);
     _staticHittables = std::make_unique<Hittables>(true, _useBvh, _useSAH);
-    _dynamicHittables = std::make_unique<Hittables>(false, _useBvh, _useSAH);
+    _dynamicHittables = std::make_unique<Hittables>(false, _useBvh, _useSAH, _useDynamicLbvh);
 
     if (_lightingEnabled)
     {
@@ -82,7 +91,73 @@ void App::InitCoreSystems()
     //Job system Inits
     if (_isThreaded)
     {
-        _jobManager = std::make_unique<JobManager>(_totalThreads);
+        //The main thread runs jobs too while it waits on them, so the pool leaves a hardware thread for it
+        _jobManager = std::make_unique<JobManager>(_totalThreads - 1);
+        _tileScheduler = std::make_unique<TileScheduler>(_tileSize);
+        _tileScheduler->Resize(_width, _height, _jobManager->GetThreadCount());
+        BuildFrameGraph();
+    }
+}
+
+void App::BuildFrameGraph()
+{
+    _frameGraph.Clear();
+    _uploadRowTasks.clear();
+
+    //The two lists share nothing so they refit side by side. A task can't wait on jobs of its own so these go without the JobManager,
+    //refits never use it and only load time builds are big enough to thread anyway
+    TaskGraph::TaskId refitStatic = _frameGraph.AddTask([this]()
+    {
+        if (_useBvh)
+        {
+            _staticHittables->UpdateBvh();
+        }
+    });
+    TaskGraph::TaskId refitDynamic = _frameGraph.AddTask([this]()
+    {
+        if (_useBvh)
+        {
+            _dynamicHittables->UpdateBvh();
+        }
+    });
+
+    //Stats only read the trees, so they can print while the frame traces
+    _frameGraph.AddTask([this]()
+    {
+        if (_reportBvhStats)
+        {
+            ReportBvhStats(_dumpBvhStats);
+        }
+    }, { refitStatic, refitDynamic }, TaskGraph::Affinity::MAIN_THREAD);
+
+    //Every tile can hit anything in either list so tracing has to wait on both refits
+    TaskGraph::TaskId traceTiles = _frameGraph.AddTask([this]()
+    {
+        _tileScheduler->QueueFrame(_jobManager.get(),
+            [this](const TileScheduler::Tile& tile) { CreateImageTile(tile); },
+            [this](int row) { _frameGraph.Signal(_uploadRowTasks[row]); },
+            &_frameCancel);
+    }, { refitStatic, refitDynamic });
+
+    //Colours are tonemapped down to 8 bits as each pixel is traced, so a row of tiles can go up to the texture as soon as it's done
+    for (int row = 0; row < _tileScheduler->GetRowCount(); ++row)
+    {
+        TaskGraph::TaskId upload = _frameGraph.AddTask([this, row]()
+        {
+            //Uploads are the main thread's regular stop during a frame so it checks the input here too
+            if (!_frameCancel.IsCancelled() && ReadFrameInput() != _frameInput)
+            {
+                _frameCancel.Cancel();
+            }
+
+            //Rows cancelling cut short are missing tiles, the screen keeps the last frame's pixels there instead
+            if (_tileScheduler->IsRowComplete(row))
+            {
+                UploadRenderRows(_tileScheduler->GetRowY(row), _tileScheduler->GetRowHeight(row));
+            }
+        }, { traceTiles }, TaskGraph::Affinity::MAIN_THREAD);
+        _frameGraph.AddSignalDependency(upload);
+        _uploadRowTasks.push_back(upload);
     }
 }
 
@@ -99,8 +174,9 @@ void App::InitScene()
     //Prompt the hittables to construt their BVH's
     if (_useBvh)
     {
-        _staticHittables->ConstructBvh();
-        _dynamicHittables->ConstructBvh();
+        //The static tree's treelet passes finish as background work while the first frames render
+        _staticHittables->ConstructBvh(_jobManager.get(), true);
+        _dynamicHittables->ConstructBvh(_jobManager.get());
     }
 }
 
@@ -176,7 +252,9 @@ void App::SpawnMeshes()
             _useMeshBvh,
             _useMeshSAH,
             Mesh::ModelParams::DEFAULT,
-            _sceneLight.get()
+            _sceneLight.get(),
+            _jobManager.get(),
+            _useMeshSpatialSplits
         )
     );
 
@@ -242,7 +320,9 @@ void App::SpawnMeshStress()
             _useMeshBvh,
             _useMeshSAH,
             Mesh::ModelParams::DEFAULT,
-            _sceneLight.get()
+            _sceneLight.get(),
+            _jobManager.get(),
+            _useMeshSpatialSplits
         )
     );
 
@@ -257,7 +337,9 @@ void App::SpawnMeshStress()
             _useMeshBvh,
             _useMeshSAH,
             Mesh::ModelParams::DEFAULT,
-            _sceneLight.get()
+            _sceneLight.get(),
+            _jobManager.get(),
+            _useMeshSpatialSplits
         )
     );
 
@@ -272,7 +354,9 @@ void App::SpawnMeshStress()
             _useMeshBvh,
             _useMeshSAH,
             Mesh::ModelParams::DEFAULT,
-            _sceneLight.get()
+            _sceneLight.get(),
+            _jobManager.get(),
+            _useMeshSpatialSplits
         )
     );
 }
@@ -466,24 +550,53 @@ void App::Update(float dt)
     }
 
 
+    bool printStats = _pEventHander->IsKeyPressed(sf::Keyboard::B);
+    bool dumpStats = _pEventHander->IsKeyPressed(sf::Keyboard::J);
+    bool reportStats = (printStats || dumpStats) && !_bvhStatsKeyDown;
+    _bvhStatsKeyDown = printStats || dumpStats;
+
     if (_isThreaded)
     {
-        _currentDivision = _totalThreads;
-        std::function<void()> call = std::bind(&App::CreateImageSegment, this);
+        //Refits, tracing and the upload overlap as far as their data lets them, see BuildFrameGraph
+        _reportBvhStats = reportStats;
+        _dumpBvhStats = dumpStats;
+        _frameInput = ReadFrameInput();
+        _frameCancel.Reset();
+        _frameGraph.Run(_jobManager.get());
+    }
+    else
+    {
+        //Refit anything that moved this frame before tracing against it
+        if (_useBvh)
+        {
+            _staticHittables->UpdateBvh();
+            _dynamicHittables->UpdateBvh();
+        }
 
-        for (int i = 0; i < _totalThreads; ++i)
+        if (reportStats)
         {
-            _jobManager->AddJobToQueue(JobManager::Job(call));
+            ReportBvhStats(dumpStats);
         }
 
-        _jobManager->ProcessJobs();
+        CreateImage();
         UpdateRenderTexture();
     }
-    else
+}
+
+uint32_t App::ReadFrameInput()
+{
+    //Held keys keep moving things every frame, that's already part of the frame being traced, only a press or release makes it stale
+    const sf::Keyboard::Key keys[] = { sf::Keyboard::W, sf::Keyboard::A, sf::Keyboard::S, sf::Keyboard::D, sf::Keyboard::Q, sf::Keyboard::E, sf::Keyboard::Up, sf::Keyboard::Down };
+
+    uint32_t input = 0;
+    for (uint32_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i)
     {
-        CreateImage();
-        UpdateRenderTexture();
+        if (_pEventHander->IsKeyPressed(keys[i]))
+        {
+            input |= 1u << i;
+        }
     }
+    return input;
 }
 
 void App::Draw()
@@ -528,6 +641,12 @@ void App::UpdateRenderTexture()
     }
 }
 
+void App::UploadRenderRows(int y, int height)
+{
+    const sf::Uint8* pixels = reinterpret_cast<const sf::Uint8*>(_pixelColourBuffer->GetDataBasePointer());
+    _renderTexture->update(pixels + static_cast<size_t>(y) * _width * sizeof(sf::Color), _width, height, 0, y);
+}
+
 void App::CreateImage()
 {
     //Draw a ray for each pixel, store the resultant colour
@@ -542,42 +661,17 @@ void App::CreateImage()
     }
 }
 
-void App::CreateImageSegment()
+void App::CreateImageTile(const TileScheduler::Tile& tile)
 {
-    //Use the current division to work of a section to iterate through based from width * height and the total thread count
-    //Translate the total value back into an X and Y
-    int startInd, endInd, currentDiv;
-
-    //Scope to lock the mutex whilst grabbing current div
-    {
-        std::lock_guard<std::mutex> lock(_divisionMutex);
-        currentDiv = _currentDivision;
-        --_currentDivision;
-    }
-    
-    startInd = (currentDiv - 1) * _calcsPerDivision;
-    endInd = currentDiv * _calcsPerDivision;
-
-    for (int i = startInd; i < endInd; ++i)
+    //Same per pixel calc as CreateImage, just limited to the pixels inside the tile
+    for (int y = tile.y; y < tile.y + tile.height; ++y)
     {
-        //Take the current i, translate it into X and Y
-        int x, y;
-
-        if (i == 0)
-        {
-            x = y = 0;
-        }
-        else
+        for (int x = tile.x; x < tile.x + tile.width; ++x)
         {
-            x = i % _width;
-            y = floor(i / _width);
+            double u = double(x / double(_width));
+            double v = double(y / double(_height));
+            _pixelColourBuffer->ColourPixelAtIndex(y * _width + x, CalculatePixel(u, v));
         }
-
-        //Do the normal Calc from before
-        double u = double(x / double(_width));
-        double v = double(y / double(_height));
-        //std::cout << "Pixel Positions: " << x << ", " << y << std::endl;
-        _pixelColourBuffer->ColourPixelAtIndex(i, CalculatePixel(u, v));
     }
 }
 
@@ -682,3 +776,29 @@ void App::GetColourAntiAliasing(const double& u, const double& v, sf::Color& col
     //tempColValues /= static_cast<double>(_perPixelAA);
     //colOut = tempColValues.Vec3ToCol();
 }
+
+void App::ReportBvhStats(bool asJson)
+{
+    std::vector<BvhStats> stats;
+    _staticHittables->GatherBvhStats("Static", stats);
+    _dynamicHittables->GatherBvhStats("Dynamic", stats);
+
+    if (!asJson)
+    {
+        for (const BvhStats& tree : stats)
+        {
+            tree.Print(std::cout);
+        }
+        return;
+    }
+
+    std::ofstream file(_bvhStatsPath);
+    if (!file)
+    {
+        std::cout << "Couldn't open '" << _bvhStatsPath << "' to write the BVH stats!" << std::endl;
+        return;
+    }
+
+    BvhStats::WriteJson(file, stats);
+    std::cout << "Stats for " << stats.size() << " BVHs written to '" << _bvhStatsPath << "'" << std::endl;
+}
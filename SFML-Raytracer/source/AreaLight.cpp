@@ -14,10 +14,6 @@ AreaLight::~AreaLight()
 
 void AreaLight::CalculateLighting(const AA::Ray& inRay, Hittable::HitResult& res, const bool& isRecursive)
 {
-    Hittable::HitResult staticRes, dynamicRes;
-    bool staticHit = false;
-    bool dynamicHit = false;
-
     //Create the collision point and material calc as they will be used more than once, set up the other vars for later use
     AA::Vec3 collisionPoint = res.p;
     AA::Ray outRay = AA::Ray(collisionPoint, collisionPoint);
@@ -47,15 +43,15 @@ void AreaLight::CalculateLighting(const AA::Ray& inRay, Hittable::HitResult& res
         AA::Vec3 lightPosition = AA::Vec3(xDist(_ranGenerator), yDist(_ranGenerator), _position.Z());
 
         //Adjust outray to match the new position its sampled to and shift it slightly along its normal
-        outRay._dir = AA::Vec3::UnitVector(lightPosition - collisionPoint);
+        outRay._dir = AA::Vec3::FastUnitVector(lightPosition - collisionPoint);
         outRay._startPos = collisionPoint;
-        outRay._startPos = outRay.GetPointAlongRay(AA::kEpsilon);
+        outRay._startPos = outRay.GetPointAlongRay(AA::kHitEpsilon);
 
         //Do the material calc based on the new data from the new outRay
         AA::Vec3 materialCalc = res.mat->MaterialActive() ? res.mat->MaterialCalculatedColour(inRay, res, this) : AA::Vec3(res.col.r / 255, res.col.g / 255, res.col.b / 255);
 
         //Check if the dot of the hit max zero returns zero and if it does the light calc doesnt need to be done as the normal is the opposide side to the light ray
-        double nDotDHit = std::max(res.normal.DotProduct(outRay._dir), 0.0);
+        double nDotDHit = std::max(res.normal.DotProduct(outRay._dir), AA::Real(0));
         if(nDotDHit == 0.0) { continue; }
         double nDotDLight = _normal.DotProduct(AA::Vec3::UnitVector(collisionPoint - lightPosition));
 
@@ -63,10 +59,9 @@ void AreaLight::CalculateLighting(const AA::Ray& inRay, Hittable::HitResult& res
         double dist = collisionPoint.Distance(lightPosition);
 
         ////Check against a hit with both static and dynamics
-        staticHit = _statics == nullptr ? false : _statics->IntersectedRayOnly(outRay, 0.0, dist, staticRes);
-        dynamicHit = _dynamics == nullptr ? false : _dynamics->IntersectedRayOnly(outRay, 0.0, dist, dynamicRes);
+        bool shadowed = IsOccluded(outRay, dist);
 
-        if (!staticHit && !dynamicHit)
+        if (!shadowed)
         {
             AA::Vec3 reflectance = ((nDotDHit * nDotDLight) / (dist * dist) ) * materialCalc * _lightColorVec * _intensityMod;
 
@@ -114,15 +109,15 @@ AA::Vec3 AreaLight::CalculateLightingForMaterial(const AA::Ray& inRay, const Hit
         AA::Vec3 lightPosition = AA::Vec3(xDist(_ranGenerator), yDist(_ranGenerator), _position.Z());
 
         //Adjust outray to match the new position its sampled to and shift it slightly along its normal
-        outRay._dir = AA::Vec3::UnitVector(lightPosition - collisionPoint);
+        outRay._dir = AA::Vec3::FastUnitVector(lightPosition - collisionPoint);
         outRay._startPos = collisionPoint;
-        outRay._startPos = outRay.GetPointAlongRay(AA::kEpsilon);
+        outRay._startPos = outRay.GetPointAlongRay(AA::kHitEpsilon);
 
         //Do the material calc based on the new data from the new outRay
         AA::Vec3 materialCalc = res.mat->MaterialActive() ? res.mat->MaterialCalculatedColour(inRay, res, this) : AA::Vec3(res.col.r / 255, res.col.g / 255, res.col.b / 255);
 
         //Check if the dot of the hit max zero returns zero and if it does the light calc doesnt need to be done as the normal is the opposide side to the light ray
-        double nDotDHit = std::max(res.normal.DotProduct(outRay._dir), 0.0);
+        double nDotDHit = std::max(res.normal.DotProduct(outRay._dir), AA::Real(0));
         double nDotDLight = _normal.DotProduct(AA::Vec3::UnitVector(collisionPoint - lightPosition));
 
         //Calc the distance from hit to light
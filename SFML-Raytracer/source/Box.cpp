@@ -104,6 +104,7 @@ void Box::Move(AA::Vec3 newPos)
     if(_isStatic) { return; }
 	_origin = newPos;
 	UpdateBounds();
+	_isDirty = true;
 }
 
 void Box::Scale(AA::Vec3 newScale)
@@ -113,6 +114,7 @@ void Box::Scale(AA::Vec3 newScale)
 	_scale[1] = newScale.Y();
 	_scale[2] = newScale.Z();
 	UpdateBounds();
+	_isDirty = true;
 }
 
 void Box::OverrideNormal(AA::Vec3 norm)
@@ -217,6 +219,12 @@ bool Box::IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max, Hit
     return true;
 }
 
+bool Box::Occluded(const AA::Ray& ray, double t_min, double t_max)
+{
+    //Same room lighting hack as IntersectedRayOnly, boxes never cast shadows
+    return false;
+}
+
 bool Box::BoundingBox(double t0, double t1, AABB& outBox) const
 {
     outBox = AABB(
@@ -87,6 +87,17 @@ bool BvhNode::IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max,
 	return false;
 }
 
+bool BvhNode::Occluded(const AA::Ray& ray, double t_min, double t_max)
+{
+	if (!_box.IntersectedRay(ray, t_min, t_max))
+	{
+		return false;
+	}
+
+	//Any hit ends it so there's no need to find the closest one
+	return _left->Occluded(ray, t_min, t_max) || (_right != _left && _right->Occluded(ray, t_min, t_max));
+}
+
 bool BvhNode::BoundingBox(double t0, double t1, AABB& outBox) const
 {
 	outBox = _box;
@@ -164,7 +175,7 @@ void BvhNode::DumbConstruction(std::vector<Hittable*> hittables, double t0, doub
 void BvhNode::SmartConstruction(std::vector<Hittable*> hittables, double t0, double t1)
 {
 	//If theres only one or two hittables deal with the exceptions, otherwise recursively make another set of bvh's
-	//TODO Add cost for making a leaf cause currently its not better
+	//No leaf cost here, LinearBvh weighs that up after flattening and merges small subtrees back into leaves where the SAH says so
 	if (hittables.size() == 1)
 	{
 		_left = _right = hittables[0];
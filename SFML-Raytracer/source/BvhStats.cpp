@@ -0,0 +1,165 @@
+#include "..\include\BvhStats.h"
+#include <algorithm>
+#include <iomanip>
+
+BvhStats BvhStats::Gather(const std::string& name, const LinearBvh& bvh, const std::vector<Hittable*>& hittables)
+{
+	BvhStats stats;
+	stats._name = name;
+	stats._primCount = static_cast<uint32_t>(hittables.size());
+
+	const std::vector<LinearBvh::Node>& nodes = bvh.GetNodes();
+	const std::vector<uint32_t>& primIndices = bvh.GetPrimIndices();
+	stats._nodeCount = static_cast<uint32_t>(nodes.size());
+	stats._sahCost = bvh.SahCost();
+
+	const WideBvh& wideBvh = bvh.GetWideBvh();
+	stats._quantised = wideBvh.IsQuantised();
+	stats._wideNodeCount = static_cast<uint32_t>(stats._quantised ? wideBvh.GetQuantisedNodes().size() : wideBvh.GetNodes().size());
+	stats._wideNodeBytes = static_cast<uint64_t>(stats._wideNodeCount) * (stats._quantised ? sizeof(WideBvh::QuantisedNode) : sizeof(WideBvh::Node));
+	if (nodes.empty())
+	{
+		return stats;
+	}
+
+	//Children always come after their parent so one pass forwards hands every node its depth before it's reached
+	std::vector<uint32_t> depths(nodes.size(), 1);
+	double overlapArea = 0.0;
+	double interiorArea = 0.0;
+	double inflationSum = 0.0;
+	uint32_t inflationLeaves = 0;
+	uint64_t leafDepthSum = 0;
+
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		const LinearBvh::Node& node = nodes[i];
+		uint32_t depth = depths[i];
+
+		if (node.primCount == 0)
+		{
+			const AABB& left = nodes[i + 1].box;
+			const AABB& right = nodes[node.offset].box;
+			depths[i + 1] = depth + 1;
+			depths[node.offset] = depth + 1;
+
+			AABB overlap = AABB::Intersection(left, right);
+			overlapArea += overlap.IsEmpty() ? 0.0 : overlap.SurfaceArea();
+			interiorArea += node.box.SurfaceArea();
+			continue;
+		}
+
+		stats._leafCount++;
+		stats._maxDepth = std::max(stats._maxDepth, depth);
+		leafDepthSum += depth;
+		if (stats._leafDepths.size() <= depth)
+		{
+			stats._leafDepths.resize(depth + 1, 0);
+		}
+		stats._leafDepths[depth]++;
+		if (stats._leafSizes.size() <= node.primCount)
+		{
+			stats._leafSizes.resize(node.primCount + 1, 0);
+		}
+		stats._leafSizes[node.primCount]++;
+
+		//Tight bounds skip any padding a primitive adds to the box it hands the builders
+		AABB tightBox = AABB::Empty();
+		for (uint32_t p = 0; p < node.primCount; ++p)
+		{
+			AABB primBox;
+			if (hittables[primIndices[node.offset + p]]->TightBoundingBox(primBox))
+			{
+				tightBox.Expand(primBox);
+			}
+		}
+
+		double tightArea = tightBox.SurfaceArea();
+		if (tightArea > 0.0 && tightArea < INFINITY)
+		{
+			inflationSum += node.box.SurfaceArea() / tightArea;
+			inflationLeaves++;
+		}
+	}
+
+	stats._averageLeafDepth = stats._leafCount > 0 ? static_cast<double>(leafDepthSum) / stats._leafCount : 0.0;
+	stats._overlapRatio = interiorArea > 0.0 ? overlapArea / interiorArea : 0.0;
+	stats._leafInflation = inflationLeaves > 0 ? inflationSum / inflationLeaves : 0.0;
+	return stats;
+}
+
+void BvhStats::Print(std::ostream& out) const
+{
+	out << "BVH '" << _name << "'" << std::endl;
+	out << "  Prims: " << _primCount << "  Nodes: " << _nodeCount << "  Leaves: " << _leafCount << std::endl;
+	out << "  SAH cost: " << _sahCost << std::endl;
+	out << "  Wide nodes: " << _wideNodeCount << (_quantised ? " quantised" : " float") << " taking " << _wideNodeBytes / 1024 << " KB" << std::endl;
+	out << "  Leaf depth: max " << _maxDepth << " average " << _averageLeafDepth << std::endl;
+	out << "  Overlap ratio: " << _overlapRatio << std::endl;
+	out << "  Leaf inflation: " << _leafInflation << std::endl;
+	PrintHistogram(out, "Leaves per depth", _leafDepths);
+	PrintHistogram(out, "Leaves per prim count", _leafSizes);
+}
+
+void BvhStats::PrintHistogram(std::ostream& out, const char* title, const std::vector<uint32_t>& counts) const
+{
+	out << "  " << title << ":" << std::endl;
+	for (size_t i = 0; i < counts.size(); ++i)
+	{
+		if (counts[i] == 0) { continue; }
+
+		//Bars are scaled against the leaf count so histograms from different trees can be compared by eye
+		int barLength = static_cast<int>(40.0 * counts[i] / std::max(_leafCount, 1u) + 0.5);
+		out << "    " << std::setw(3) << i << " | " << std::setw(8) << counts[i] << " " << std::string(barLength, '#') << std::endl;
+	}
+}
+
+void BvhStats::WriteJson(std::ostream& out, const std::vector<BvhStats>& stats)
+{
+	out << "{" << std::endl << "\t\"trees\": [";
+	for (size_t i = 0; i < stats.size(); ++i)
+	{
+		out << (i == 0 ? "" : ",") << std::endl;
+		stats[i].WriteJsonTree(out);
+	}
+	out << std::endl << "\t]" << std::endl << "}" << std::endl;
+}
+
+void BvhStats::WriteJsonTree(std::ostream& out) const
+{
+	//Names are model paths which can hold backslashes on windows
+	std::string name;
+	for (char c : _name)
+	{
+		if (c == '\\' || c == '"') { name += '\\'; }
+		name += c;
+	}
+
+	auto writeArray = [&out](const std::vector<uint32_t>& values)
+	{
+		out << "[";
+		for (size_t i = 0; i < values.size(); ++i)
+		{
+			out << (i == 0 ? "" : ", ") << values[i];
+		}
+		out << "]";
+	};
+
+	out << "\t\t{" << std::endl;
+	out << "\t\t\t\"name\": \"" << name << "\"," << std::endl;
+	out << "\t\t\t\"primCount\": " << _primCount << "," << std::endl;
+	out << "\t\t\t\"nodeCount\": " << _nodeCount << "," << std::endl;
+	out << "\t\t\t\"leafCount\": " << _leafCount << "," << std::endl;
+	out << "\t\t\t\"sahCost\": " << _sahCost << "," << std::endl;
+	out << "\t\t\t\"wideNodeCount\": " << _wideNodeCount << "," << std::endl;
+	out << "\t\t\t\"wideNodeBytes\": " << _wideNodeBytes << "," << std::endl;
+	out << "\t\t\t\"quantised\": " << (_quantised ? "true" : "false") << "," << std::endl;
+	out << "\t\t\t\"maxDepth\": " << _maxDepth << "," << std::endl;
+	out << "\t\t\t\"averageLeafDepth\": " << _averageLeafDepth << "," << std::endl;
+	out << "\t\t\t\"overlapRatio\": " << _overlapRatio << "," << std::endl;
+	out << "\t\t\t\"leafInflation\": " << _leafInflation << "," << std::endl;
+	out << "\t\t\t\"leafDepths\": ";
+	writeArray(_leafDepths);
+	out << "," << std::endl << "\t\t\t\"leafSizes\": ";
+	writeArray(_leafSizes);
+	out << std::endl << "\t\t}";
+}
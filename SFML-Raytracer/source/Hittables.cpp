@@ -1,9 +1,11 @@
 #include "..\include\Hittables.h"
 #include "Material.h"
+#include "BvhStats.h"
+#include "JobManager.h"
 
-Hittables::Hittables(bool isHittableStatic, bool useBvh, bool useSAH) : Hittable(isHittableStatic, new Material(sf::Color(255,255,255,255), false), nullptr), _bvhEnabled(useBvh), _sahEnabled(useSAH)
+Hittables::Hittables(bool isHittableStatic, bool useBvh, bool useSAH, bool useLbvh) : Hittable(isHittableStatic, new Material(sf::Color(255,255,255,255), false), nullptr), _bvhEnabled(useBvh), _sahEnabled(useSAH), _lbvhEnabled(useLbvh), _bvhGeneration(0), _optimisedBvhReady(false)
 {
-	_bvh = std::make_unique<BvhNode>();
+	_bvh = std::make_unique<LinearBvh>();
 }
 
 Hittables::~Hittables()
@@ -26,14 +28,16 @@ bool Hittables::IntersectedRay(const AA::Ray& ray, double tmin, double tmax, Hit
 	//Create a bvh of the hittables, then do the iterations of the ray against the bvh intersect ray
 	if (_bvhEnabled)
 	{
-		//If the objects can move then we need to remake the bvh, TODO Set a dirty flag later so this isnt done everyyyyy update
-		if(!_isStatic || !_bvh->IsConstructed()) { ConstructBvh(); }
-		didHit = _bvh->IntersectedRay(ray, tmin, tmax, tempRes);
-
-		if (didHit)
+		didHit = _bvh->Traverse(ray, tmin, tmax, [&](uint32_t primIndex, double& closest)
 		{
-			res = tempRes;
-		}
+			if (_hittableObjects[primIndex]->IntersectedRay(ray, tmin, closest, tempRes) && tempRes.t < closest)
+			{
+				closest = tempRes.t;
+				res = tempRes;
+				return true;
+			}
+			return false;
+		});
 	}
 
 	//// Without BVH
@@ -68,17 +72,16 @@ bool Hittables::IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_ma
 	//Create a bvh of the hittables, then do the iterations of the ray against the bvh intersect ray
 	if (_bvhEnabled)
 	{
-		//If the objects can move then we need to remake the bvh, TODO Set a dirty flag later so this isnt done everyyyyy update
-		if (!_isStatic || !_bvh->IsConstructed())
+		didHit = _bvh->Traverse(ray, t_min, t_max, [&](uint32_t primIndex, double& closest)
 		{
-			ConstructBvh();
-		}
-		didHit = _bvh->IntersectedRayOnly(ray, t_min, t_max, tempRes);
-
-		if (didHit)
-		{
-			res = tempRes;
-		}
+			if (_hittableObjects[primIndex]->IntersectedRayOnly(ray, t_min, closest, tempRes) && tempRes.t < closest)
+			{
+				closest = tempRes.t;
+				res = tempRes;
+				return true;
+			}
+			return false;
+		});
 	}
 
 	//// Without BVH
@@ -98,6 +101,33 @@ bool Hittables::IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_ma
 	return didHit;
 }
 
+bool Hittables::Occluded(const AA::Ray& ray, double t_min, double t_max)
+{
+	if (_hittableObjects.size() == 0)
+	{
+		return false;
+	}
+
+	////With BVH
+	if (_bvhEnabled)
+	{
+		return _bvh->TraverseAny(ray, t_min, t_max, [&](uint32_t primIndex)
+		{
+			return _hittableObjects[primIndex]->Occluded(ray, t_min, t_max);
+		});
+	}
+
+	//// Without BVH
+	for (auto& hitt : _hittableObjects)
+	{
+		if (hitt->Occluded(ray, t_min, t_max))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 //This function relies on the first object in the scene having a valid AABB, AKA FIRST OBJECT CANT BE AN INFITE PLANE
 bool Hittables::BoundingBox(double t0, double t1, AABB& outBox) const
 {
@@ -128,7 +158,100 @@ bool Hittables::BoundingBox(double t0, double t1, AABB& outBox) const
 	return didExpand;
 }
 
-void Hittables::ConstructBvh()
+void Hittables::ConstructBvh(JobManager* jobManager, bool optimiseInBackground)
 {
-	_bvh->ConstructBVH(_hittableObjects, 0.0, 0.0, _sahEnabled);
+	LinearBvh::BuildType type = LinearBvh::BuildType::DUMB;
+	if (_lbvhEnabled)
+	{
+		type = LinearBvh::BuildType::MORTON;
+	}
+	else if (_sahEnabled)
+	{
+		type = LinearBvh::BuildType::BINNED_SAH;
+	}
+
+	//Static lists are built once and traced every frame after so the slower treelet pass pays for itself
+	bool wantsTreelets = _isStatic && type == LinearBvh::BuildType::BINNED_SAH;
+	bool deferTreelets = wantsTreelets && optimiseInBackground && jobManager != nullptr;
+	uint32_t generation = ++_bvhGeneration;
+
+	_bvh->SetTreeletPasses(wantsTreelets && !deferTreelets ? LinearBvh::kStaticTreeletPasses : 0);
+	_bvh->Build(_hittableObjects, type, jobManager);
+
+	if (deferTreelets)
+	{
+		jobManager->AddJobToQueue(JobManager::Job([this, type, generation]() { BuildOptimisedBvh(type, generation); }), JobManager::Priority::LOW);
+	}
+}
+
+void Hittables::BuildOptimisedBvh(LinearBvh::BuildType type, uint32_t generation)
+{
+	//Builds into its own tree so the frames tracing the current one aren't affected, and without the JobManager as a job can't wait on others
+	std::unique_ptr<LinearBvh> bvh = std::make_unique<LinearBvh>();
+	bvh->SetTreeletPasses(LinearBvh::kStaticTreeletPasses);
+	bvh->Build(_hittableObjects, type);
+
+	std::lock_guard<std::mutex> lock(_optimisedBvhMutex);
+	_optimisedBvh = std::move(bvh);
+	_optimisedBvhGeneration = generation;
+	_optimisedBvhReady.store(true);
+}
+
+void Hittables::UpdateBvh(JobManager* jobManager)
+{
+	//Let everything refresh its own BVH first so the bounds read by the refit below are up to date
+	bool anyDirty = false;
+	for (auto& obj : _hittableObjects)
+	{
+		obj->UpdateBvh(jobManager);
+		if (obj->IsDirty())
+		{
+			anyDirty = true;
+			obj->ClearDirty();
+		}
+	}
+
+	if (!_bvhEnabled)
+	{
+		return;
+	}
+
+	//Anything moving, whether the refit below absorbs it or not, means a tree built in the background has the wrong bounds
+	if (anyDirty)
+	{
+		++_bvhGeneration;
+	}
+
+	//Nothing traces between the refit and the frame, so it's the one safe spot to swap in a tree built in the background
+	if (_optimisedBvhReady.exchange(false))
+	{
+		std::lock_guard<std::mutex> lock(_optimisedBvhMutex);
+		if (_optimisedBvhGeneration == _bvhGeneration.load())
+		{
+			_bvh = std::move(_optimisedBvh);
+		}
+		_optimisedBvh.reset();
+	}
+
+	//Refit keeps the tree from the last build and only grows the boxes, once they overlap too much it's cheaper to rebuild than keep tracing through it
+	//An LBVH is cheap enough to rebuild outright so it never goes through a refit
+	if (!_bvh->IsConstructed() || (anyDirty && (_lbvhEnabled || !_bvh->Refit(_hittableObjects))))
+	{
+		ConstructBvh(jobManager);
+	}
+
+	_isDirty |= anyDirty;
+}
+
+void Hittables::GatherBvhStats(const std::string& name, std::vector<BvhStats>& outStats) const
+{
+	if (_bvhEnabled && _bvh->IsConstructed())
+	{
+		outStats.push_back(BvhStats::Gather(name, *_bvh, _hittableObjects));
+	}
+
+	for (size_t i = 0; i < _hittableObjects.size(); ++i)
+	{
+		_hittableObjects[i]->GatherBvhStats(name + "/" + std::to_string(i), outStats);
+	}
 }
@@ -1,61 +1,184 @@
 #include "..\include\JobManager.h"
-#include <vector>
-#include <algorithm>
-#include <iostream>
-#include <random>
 
-JobManager::JobManager(int jobQueueSize)
+JobManager::JobManager(int jobQueueSize) : _mainThreadId(std::this_thread::get_id()), _mainThreadJobCount(0), _sleepingThreads(0)
 {
 	_threads.reserve(jobQueueSize);
 
-	for (size_t i = 0; i < jobQueueSize; i++)
+	for (int i = 0; i < jobQueueSize; i++)
 	{
-		_threads.emplace_back(std::make_unique<PoolableThread>());
+		_threads.emplace_back(std::make_unique<PoolableThread>([this]() { WorkerLoop(); }));
 	}
 }
 
 JobManager::~JobManager()
 {
-	_jobQueue.clear();
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_shuttingDown = true;
+	}
+	_wakeUp.notify_all();
+
+	//Joins every worker before the queue and condition variable they use go away
+	_threads.clear();
 }
 
-void JobManager::AddJobToQueue(Job job)
+void JobManager::AddJobToQueue(Job job, Priority priority)
 {
-	std::lock_guard<std::mutex> lock(_jobQueueMutex);
-	_jobQueue.push_back(job);
+	PriorityLevel& level = _levels[static_cast<int>(priority)];
+	++level.unfinishedJobs;
+	if (!level.queue.TryPush(std::move(job)))
+	{
+		//Ring's full, running it here gets it done no later than waiting for a slot would
+		job();
+		FinishJob(priority);
+		return;
+	}
+
+	//The push and this load pair up with a sleeper's increment and its empty check, so either it sees the job or we see it and wake it
+	//Taking the mutex first means a sleeper that has just checked the queue is properly waiting before the notify goes out
+	if (_sleepingThreads.load() > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_sleepMutex);
+		}
+
+		//A waiting ProcessJobs might not take this priority, waking everyone makes sure a worker that will gets it
+		if (priority == Priority::HIGH)
+		{
+			_wakeUp.notify_one();
+		}
+		else
+		{
+			_wakeUp.notify_all();
+		}
+	}
 }
 
-void JobManager::ProcessJobs()
+void JobManager::AddMainThreadJob(Job job)
 {
-	//First we send jobs onto the pooled threads by checking if the thread is idle and if so giving it the job
-	std::list<Job>::iterator jobIter = _jobQueue.begin();
+	++_levels[static_cast<int>(Priority::HIGH)].unfinishedJobs;
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_mainThreadJobs.push_back(std::move(job));
+		++_mainThreadJobCount;
+	}
 
-	while (jobIter != _jobQueue.end())
+	//Can't tell which sleeper is the main thread so everyone gets woken, workers just go back to sleep
+	_wakeUp.notify_all();
+}
+
+void JobManager::RunMainThreadJobs()
+{
+	if (std::this_thread::get_id() != _mainThreadId)
+	{
+		return;
+	}
+
+	while (RunOneMainThreadJob())
+	{
+	}
+}
+
+void JobManager::ProcessJobs(Priority priority)
+{
+	//Help out rather than sitting idle while the pool works, jobs can keep queueing more so keep going until the count hits zero
+	bool isMainThread = std::this_thread::get_id() == _mainThreadId;
+	std::atomic<uint32_t>& unfinishedJobs = _levels[static_cast<int>(priority)].unfinishedJobs;
+	while (unfinishedJobs.load() > 0)
 	{
-		for (auto& thread : _threads)
+		//Main thread jobs go first as nobody else can take them
+		if ((isMainThread && RunOneMainThreadJob()) || RunOneJob(priority))
 		{
-			if (thread->IsThreadIdle())
-			{
-				thread->RunTaskOnThread(jobIter->dataProcessingFunction);
-				jobIter = _jobQueue.erase(jobIter);
-				break;
-			}
+			continue;
 		}
+
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		++_sleepingThreads;
+		_wakeUp.wait(lock, [&]() { return unfinishedJobs.load() == 0 || AnyJobsQueued(priority) || (isMainThread && !_mainThreadJobs.empty()); });
+		--_sleepingThreads;
 	}
+}
 
-	//When all threads return to idle then continue processing
-	bool doneProcessing = false;
-	while (!doneProcessing)
+void JobManager::WorkerLoop()
+{
+	while (true)
 	{
-		doneProcessing = true;
+		if (RunOneJob(Priority::LOW))
+		{
+			continue;
+		}
 
-		for (auto& thread : _threads)
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		++_sleepingThreads;
+		_wakeUp.wait(lock, [this]() { return _shuttingDown || AnyJobsQueued(Priority::LOW); });
+		--_sleepingThreads;
+		if (_shuttingDown)
+		{
+			return;
+		}
+	}
+}
+
+bool JobManager::RunOneJob(Priority lowest)
+{
+	//Starts from the top for every job, so new frame work never waits behind more than the background jobs already running
+	Job job;
+	for (int priority = 0; priority <= static_cast<int>(lowest); ++priority)
+	{
+		if (_levels[priority].queue.TryPop(job))
+		{
+			job();
+			FinishJob(static_cast<Priority>(priority));
+			return true;
+		}
+	}
+	return false;
+}
+
+bool JobManager::RunOneMainThreadJob()
+{
+	if (_mainThreadJobCount.load() == 0)
+	{
+		return false;
+	}
+
+	Job job;
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		if (_mainThreadJobs.empty())
+		{
+			return false;
+		}
+		job = std::move(_mainThreadJobs.front());
+		_mainThreadJobs.pop_front();
+		--_mainThreadJobCount;
+	}
+
+	job();
+	FinishJob(Priority::HIGH);
+	return true;
+}
+
+void JobManager::FinishJob(Priority priority)
+{
+	//Last one out wakes whoever is waiting in ProcessJobs, workers woken alongside it just go back to sleep
+	if (--_levels[static_cast<int>(priority)].unfinishedJobs == 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_sleepMutex);
+		}
+		_wakeUp.notify_all();
+	}
+}
+
+bool JobManager::AnyJobsQueued(Priority lowest) const
+{
+	for (int priority = 0; priority <= static_cast<int>(lowest); ++priority)
+	{
+		if (!_levels[priority].queue.IsEmpty())
 		{
-			if (!thread->IsThreadIdle())
-			{
-				doneProcessing = false;
-				break;
-			}
+			return true;
 		}
 	}
+	return false;
 }
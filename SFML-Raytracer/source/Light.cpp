@@ -12,27 +12,22 @@ Light::~Light()
 
 void Light::CalculateLighting(const AA::Ray& inRay, Hittable::HitResult& res, const bool& isRecursive)
 {
-    Hittable::HitResult staticRes, dynamicRes;
-    bool staticHit = false;
-    bool dynamicHit = false;
-
     //Create the collision point and material calc as they will be used more than once, set up the other vars for later use
     AA::Vec3 collisionPoint = res.p;
-    AA::Ray outRay = AA::Ray(collisionPoint, AA::Vec3::UnitVector(_position - collisionPoint));
+    AA::Ray outRay = AA::Ray(collisionPoint, AA::Vec3::FastUnitVector(_position - collisionPoint));
 
     //Adjust outray to match the new position its sampled to and shift it slightly along its normal
-    outRay._startPos = outRay.GetPointAlongRay(AA::kEpsilon);
+    outRay._startPos = outRay.GetPointAlongRay(AA::kHitEpsilon);
 
     //Otherwise move onto the visibility check
     //Calc the distance from hit to light
     double dist = collisionPoint.Distance(_position);
 
     //Check against a hit with both static and dynamics
-    staticHit = _statics == nullptr ? false : _statics->IntersectedRayOnly(outRay, 0.0, dist, staticRes);
-    dynamicHit = _dynamics == nullptr ? false : _dynamics->IntersectedRayOnly(outRay, 0.0, dist, dynamicRes);
+    bool shadowed = IsOccluded(outRay, dist);
 
 
-    if (staticHit || dynamicHit)
+    if (shadowed)
     {
         res.col = _shadowColour;
     }
@@ -40,26 +35,21 @@ void Light::CalculateLighting(const AA::Ray& inRay, Hittable::HitResult& res, co
 
 AA::Vec3 Light::CalculateLightingForMaterial(const AA::Ray& inRay, const Hittable::HitResult& res)
 {
-    Hittable::HitResult staticRes, dynamicRes;
-    bool staticHit = false;
-    bool dynamicHit = false;
-
     //Create the collision point and material calc as they will be used more than once, set up the other vars for later use
     AA::Vec3 collisionPoint = res.p;
-    AA::Ray outRay = AA::Ray(collisionPoint, AA::Vec3::UnitVector(_position - collisionPoint));
+    AA::Ray outRay = AA::Ray(collisionPoint, AA::Vec3::FastUnitVector(_position - collisionPoint));
 
     //Adjust outray to match the new position its sampled to and shift it slightly along its normal
-    outRay._startPos = outRay.GetPointAlongRay(AA::kEpsilon);
+    outRay._startPos = outRay.GetPointAlongRay(AA::kHitEpsilon);
 
     //Otherwise move onto the visibility check
     //Calc the distance from hit to light
     double dist = collisionPoint.Distance(_position);
 
     //Check against a hit with both static and dynamics
-    staticHit = _statics == nullptr ? false : _statics->IntersectedRayOnly(outRay, 0.0, dist, staticRes);
-    dynamicHit = _dynamics == nullptr ? false : _dynamics->IntersectedRayOnly(outRay, 0.0, dist, dynamicRes);
+    bool shadowed = IsOccluded(outRay, dist);
 
-    return staticHit || dynamicHit ? AA::colToVec3(_shadowColour) : AA::colToVec3(res.col);
+    return shadowed ? AA::colToVec3(_shadowColour) : AA::colToVec3(res.col);
 }
 
 bool Light::IntersectedRay(const AA::Ray& ray, double t_min, double t_max, HitResult& res)
@@ -127,6 +117,30 @@ bool Light::IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max, H
 
     return false;
 }
+
+bool Light::Occluded(const AA::Ray& ray, double t_min, double t_max)
+{
+    AA::Vec3 oc = ray._startPos - _position;
+    double a = ray._dir.DotProduct(ray._dir);
+    double b = oc.DotProduct(ray._dir);
+    double c = oc.DotProduct(oc) - _sphereRadius * _sphereRadius;
+
+    double discrim = b * b - a * c;
+    if (discrim <= 0)
+    {
+        return false;
+    }
+
+    //Either root inside the range is enough, nothing about the hit is needed
+    double root = sqrt(discrim);
+    double temp = (-b - root) / a;
+    if (temp < t_max && temp > t_min)
+    {
+        return true;
+    }
+    temp = (-b + root) / a;
+    return temp < t_max && temp > t_min;
+}
 bool Light::BoundingBox(double t0, double t1, AABB& outBox) const
 {
     return false;
@@ -0,0 +1,1595 @@
+#include "..\include\LinearBvh.h"
+#include "..\include\JobManager.h"
+#include <iostream>
+#include <numeric>
+#include <algorithm>
+#include <thread>
+#include <fstream>
+
+//Queues a job per item and blocks until the job manager has worked through all of them
+static void RunJobs(JobManager* jobManager, size_t count, const std::function<void(size_t)>& func)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		jobManager->AddJobToQueue(JobManager::Job([&func, i]() { func(i); }));
+	}
+	jobManager->ProcessJobs();
+}
+
+//Cuts count items into kThreadedChunkSize slices and runs func(start, end) on each as a job, or over everything at once on this thread without a job manager
+static void RunChunks(JobManager* jobManager, uint32_t count, const std::function<void(uint32_t, uint32_t)>& func)
+{
+	if (jobManager == nullptr)
+	{
+		func(0, count);
+		return;
+	}
+
+	const uint32_t chunkSize = LinearBvh::kThreadedChunkSize;
+	RunJobs(jobManager, (count + chunkSize - 1) / chunkSize, [&](size_t chunk)
+	{
+		uint32_t start = static_cast<uint32_t>(chunk) * chunkSize;
+		func(start, std::min(start + chunkSize, count));
+	});
+}
+
+//Position of the lowest set bit, the treelet pass numbers its leaves by bit so a single bit set picks out one leaf
+static uint32_t LowestBitIndex(uint32_t bits)
+{
+	uint32_t index = 0;
+	while ((bits & 1u) == 0)
+	{
+		bits >>= 1;
+		++index;
+	}
+	return index;
+}
+
+//Spreads the low 21 bits out so there are two empty bits after each one, ready to be interleaved with the other two axis
+static uint64_t SpreadMortonBits(uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffff;
+	v = (v | v << 16) & 0x1f0000ff0000ff;
+	v = (v | v << 8) & 0x100f00f00f00f00f;
+	v = (v | v << 4) & 0x10c30c30c30c30c3;
+	v = (v | v << 2) & 0x1249249249249249;
+	return v;
+}
+
+void LinearBvh::Build(const std::vector<Hittable*>& hittables, BuildType type, JobManager* jobManager)
+{
+	Clear();
+	if (hittables.size() == 0) { return; }
+	_primCount = static_cast<uint32_t>(hittables.size());
+
+	switch (type)
+	{
+		case BuildType::DUMB:
+			BuildFromBvhNode(hittables, false);
+			break;
+		case BuildType::SMART:
+			BuildFromBvhNode(hittables, true);
+			break;
+		case BuildType::MORTON:
+			BuildMorton(hittables, jobManager);
+			break;
+		case BuildType::SPATIAL_SAH:
+			BuildSpatialSah(hittables);
+			break;
+		default:
+			BuildBinnedSah(hittables, jobManager);
+			break;
+	}
+
+	if (_treeletPasses > 0)
+	{
+		OptimiseTreelets(jobManager);
+	}
+
+	MergeSmallSubtrees();
+	_builtSahCost = SahCost();
+	_wideBvh.Build(*this, _primCount >= _quantiseMinPrims);
+}
+
+bool LinearBvh::Refit(const std::vector<Hittable*>& hittables)
+{
+	if (_nodes.empty())
+	{
+		return false;
+	}
+
+	//Children always come after their parent in the array so walking it backwards reaches both of them before the parent
+	for (size_t i = _nodes.size(); i-- > 0;)
+	{
+		Node& node = _nodes[i];
+		node.box = AABB::Empty();
+
+		if (node.primCount > 0)
+		{
+			for (uint32_t p = 0; p < node.primCount; ++p)
+			{
+				AABB primBox;
+				hittables[_primIndices[node.offset + p]]->BoundingBox(0.0, 0.0, primBox);
+				node.box.Expand(primBox);
+			}
+		}
+		else
+		{
+			node.box.Expand(_nodes[i + 1].box);
+			node.box.Expand(_nodes[node.offset].box);
+		}
+	}
+
+	if (SahCost() > _builtSahCost * kRefitRebuildRatio)
+	{
+		return false;
+	}
+
+	_wideBvh.Build(*this, _primCount >= _quantiseMinPrims);
+	return true;
+}
+
+void LinearBvh::RemapPrimIndices(const std::vector<uint32_t>& newIndices)
+{
+	for (uint32_t& prim : _primIndices)
+	{
+		prim = newIndices[prim];
+	}
+	_wideBvh.Build(*this, _primCount >= _quantiseMinPrims);
+}
+
+bool LinearBvh::Save(const std::string& path, uint64_t key) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "Couldn't open BVH cache file '" << path << "' for writing!" << std::endl;
+		return false;
+	}
+
+	CacheHeader header = { kCacheMagic, kCacheVersion, sizeof(Node), _primCount, key, static_cast<uint32_t>(_nodes.size()), static_cast<uint32_t>(_primIndices.size()) };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(_nodes.data()), sizeof(Node) * _nodes.size());
+	file.write(reinterpret_cast<const char*>(_primIndices.data()), sizeof(uint32_t) * _primIndices.size());
+	return file.good();
+}
+
+bool LinearBvh::Load(const std::string& path, uint64_t key, uint32_t primCount)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	CacheHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != kCacheMagic || header.version != kCacheVersion
+		|| header.nodeSize != sizeof(Node) || header.key != key || header.primCount != primCount || header.nodeCount == 0 || header.indexCount < primCount)
+	{
+		return false;
+	}
+
+	std::vector<Node> nodes(header.nodeCount);
+	std::vector<uint32_t> primIndices(header.indexCount);
+	if (!file.read(reinterpret_cast<char*>(nodes.data()), sizeof(Node) * nodes.size()) || !file.read(reinterpret_cast<char*>(primIndices.data()), sizeof(uint32_t) * primIndices.size()))
+	{
+		return false;
+	}
+
+	//A corrupt file mustn't be able to send the traversal outside the arrays, past its stack or into a leaf bigger than any build makes,
+	//children always come after their parent so each node's depth is known by the time the pass reaches it
+	std::vector<int> depths(header.nodeCount, 0);
+	depths[0] = 1;
+	for (uint32_t i = 0; i < header.nodeCount; ++i)
+	{
+		const Node& node = nodes[i];
+		bool inRange = node.primCount > 0 ? node.primCount <= kMaxLeafPrimsLimit && node.offset <= header.indexCount && node.primCount <= header.indexCount - node.offset : node.offset > i + 1 && node.offset < header.nodeCount;
+		if (!inRange || depths[i] > kMaxStackDepth)
+		{
+			return false;
+		}
+
+		if (node.primCount == 0)
+		{
+			depths[i + 1] = std::max(depths[i + 1], depths[i] + 1);
+			depths[node.offset] = std::max(depths[node.offset], depths[i] + 1);
+		}
+	}
+	for (uint32_t prim : primIndices)
+	{
+		if (prim >= primCount)
+		{
+			return false;
+		}
+	}
+
+	Clear();
+	_nodes.swap(nodes);
+	_primIndices.swap(primIndices);
+	_primCount = primCount;
+	_builtSahCost = SahCost();
+	_wideBvh.Build(*this, _primCount >= _quantiseMinPrims);
+	return true;
+}
+
+double LinearBvh::SahCost() const
+{
+	if (_nodes.empty())
+	{
+		return 0.0;
+	}
+
+	double rootArea = _nodes[0].box.SurfaceArea();
+	if (rootArea <= 0.0)
+	{
+		return 0.0;
+	}
+
+	//Interior nodes cost a box test each, leaves cost a test per primitive, both weighted by the chance a ray through the root reaches them
+	double cost = 0.0;
+	for (const Node& node : _nodes)
+	{
+		cost += node.box.SurfaceArea() / rootArea * (node.primCount > 0 ? node.primCount * kSahPrimCost : kSahNodeCost);
+	}
+	return cost;
+}
+
+void LinearBvh::BuildFromBvhNode(const std::vector<Hittable*>& hittables, bool useSmart)
+{
+	//Map each hittable back to its place in the list so the leaves can store indices instead of pointers
+	std::unordered_map<const Hittable*, uint32_t> lookup;
+	lookup.reserve(hittables.size());
+	for (uint32_t i = 0; i < hittables.size(); ++i)
+	{
+		lookup[hittables[i]] = i;
+	}
+
+	//Let the existing builder decide the tree shape then copy it out into the flat array
+	BvhNode root;
+	root.ConstructBVH(hittables, 0.0, 0.0, useSmart);
+
+	_nodes.reserve(hittables.size() * 2);
+	_primIndices.reserve(hittables.size());
+
+	int maxDepth = 0;
+	FlattenNode(&root, lookup, 1, maxDepth);
+
+	//The traversal stack is fixed size so a degenerate tree has to be rebuilt with the median split which is always balanced
+	if (maxDepth > kMaxStackDepth)
+	{
+		std::cout << "Flattened BVH is " << maxDepth << " nodes deep which is over the limit of " << kMaxStackDepth << "!" << std::endl;
+		Clear();
+		if (useSmart)
+		{
+			BuildFromBvhNode(hittables, false);
+		}
+	}
+}
+
+void LinearBvh::GatherBuildPrims(const std::vector<Hittable*>& hittables, JobManager* jobManager, BuildPrims& outPrims) const
+{
+	//Grab every box once, the hittables are never touched again for the rest of the build
+	uint32_t primCount = static_cast<uint32_t>(hittables.size());
+	outPrims.bounds.resize(primCount);
+	outPrims.centroids.resize(primCount);
+	RunChunks(jobManager, primCount, [&](uint32_t start, uint32_t end)
+	{
+		for (uint32_t i = start; i < end; ++i)
+		{
+			hittables[i]->BoundingBox(0.0, 0.0, outPrims.bounds[i]);
+			outPrims.centroids[i] = outPrims.bounds[i].Centroid();
+		}
+	});
+}
+
+void LinearBvh::BuildBinnedSah(const std::vector<Hittable*>& hittables, JobManager* jobManager)
+{
+	uint32_t primCount = static_cast<uint32_t>(hittables.size());
+	bool threaded = jobManager != nullptr && primCount >= kThreadedBuildMinPrims;
+
+	BuildPrims prims;
+	GatherBuildPrims(hittables, threaded ? jobManager : nullptr, prims);
+
+	//The index array is partitioned in place as the tree is built, by the end it is already in leaf order
+	_primIndices.resize(primCount);
+	std::iota(_primIndices.begin(), _primIndices.end(), 0);
+	_nodes.reserve(primCount * 2);
+
+	if (threaded)
+	{
+		BuildBinnedSahThreaded(prims, jobManager);
+	}
+	else
+	{
+		BuildSahRange(prims, 0, primCount, 1, _nodes);
+	}
+}
+
+void LinearBvh::BuildBinnedSahThreaded(const BuildPrims& prims, JobManager* jobManager)
+{
+	uint32_t primCount = static_cast<uint32_t>(prims.bounds.size());
+
+	//Aim for a couple of subtrees per core so a few expensive ones don't leave the rest waiting, the pool can hold far more threads than there are cores
+	uint32_t workerCount = std::max(std::min<uint32_t>(jobManager->GetThreadCount(), std::thread::hardware_concurrency()), 1u);
+	uint32_t subtreeTarget = workerCount * 2;
+	uint32_t subtreeMaxPrims = std::max(primCount / subtreeTarget, kThreadedSubtreeMinPrims);
+
+	std::vector<TopNode> topNodes(1);
+	std::vector<PendingRange> level = { { 0, primCount, 1, 0 } };
+	std::vector<PendingRange> subtrees;
+	std::vector<uint32_t> scratch(primCount);
+
+	//The top of the tree is split a whole level at a time, every pass over the primitives for that level is cut into chunks and run as jobs
+	while (!level.empty())
+	{
+		std::vector<PendingRange> splitting;
+		for (const PendingRange& range : level)
+		{
+			if (range.end - range.start <= subtreeMaxPrims)
+			{
+				subtrees.push_back(range);
+			}
+			else
+			{
+				splitting.push_back(range);
+			}
+		}
+		level.clear();
+
+		if (splitting.empty())
+		{
+			break;
+		}
+
+		//Chunk i covers part of range chunkRanges[i], large ranges get shared out while small ones end up as a single job
+		std::vector<uint32_t> chunkRanges;
+		std::vector<uint32_t> chunkStarts;
+		std::vector<uint32_t> chunkEnds;
+		for (uint32_t r = 0; r < splitting.size(); ++r)
+		{
+			for (uint32_t start = splitting[r].start; start < splitting[r].end; start += kThreadedChunkSize)
+			{
+				chunkRanges.push_back(r);
+				chunkStarts.push_back(start);
+				chunkEnds.push_back(std::min(start + kThreadedChunkSize, splitting[r].end));
+			}
+		}
+		size_t chunkCount = chunkRanges.size();
+
+		//Node and centroid bounds for each chunk, merged per range afterwards
+		std::vector<AABB> chunkBoxes(chunkCount, AABB::Empty());
+		std::vector<AABB> chunkCentroidBoxes(chunkCount, AABB::Empty());
+		RunJobs(jobManager, chunkCount, [&](size_t c)
+		{
+			for (uint32_t i = chunkStarts[c]; i < chunkEnds[c]; ++i)
+			{
+				chunkBoxes[c].Expand(prims.bounds[_primIndices[i]]);
+				chunkCentroidBoxes[c].Expand(prims.centroids[_primIndices[i]]);
+			}
+		});
+
+		std::vector<AABB> boxes(splitting.size(), AABB::Empty());
+		std::vector<AABB> centroidBoxes(splitting.size(), AABB::Empty());
+		for (size_t c = 0; c < chunkCount; ++c)
+		{
+			boxes[chunkRanges[c]].Expand(chunkBoxes[c]);
+			centroidBoxes[chunkRanges[c]].Expand(chunkCentroidBoxes[c]);
+		}
+
+		//Same for the SAH bins, each chunk fills its own set and they get added together per range
+		std::vector<SahBins> chunkBins(chunkCount);
+		RunJobs(jobManager, chunkCount, [&](size_t c)
+		{
+			FillSahBins(prims, chunkStarts[c], chunkEnds[c], centroidBoxes[chunkRanges[c]], chunkBins[c]);
+		});
+
+		std::vector<SahBins> rangeBins(splitting.size());
+		for (size_t c = 0; c < chunkCount; ++c)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				for (int bin = 0; bin < kSahBinCount; ++bin)
+				{
+					rangeBins[chunkRanges[c]][axis][bin].box.Expand(chunkBins[c][axis][bin].box);
+					rangeBins[chunkRanges[c]][axis][bin].count += chunkBins[c][axis][bin].count;
+				}
+			}
+		}
+
+		//-1 split bin means the range skips the partition passes and goes straight to the median split
+		std::vector<int> axes(splitting.size());
+		std::vector<int> splitBins(splitting.size(), -1);
+		for (uint32_t r = 0; r < splitting.size(); ++r)
+		{
+			uint32_t count = splitting[r].end - splitting[r].start;
+			axes[r] = centroidBoxes[r].LongestAxis();
+			if (!MustSplitOnMedian(count, splitting[r].depth))
+			{
+				double splitCost;
+				FindSahSplit(rangeBins[r], count, axes[r], splitBins[r], splitCost);
+			}
+		}
+
+		auto goesLeft = [&](uint32_t r, uint32_t prim)
+		{
+			int axis = axes[r];
+			double axisMin = centroidBoxes[r].Min()[axis];
+			double binScale = kSahBinCount / (centroidBoxes[r].Max()[axis] - axisMin);
+			int bin = static_cast<int>((prims.centroids[prim][axis] - axisMin) * binScale);
+			return (bin < kSahBinCount ? bin : kSahBinCount - 1) < splitBins[r];
+		};
+
+		//Partition is done as count, prefix sum then scatter into the scratch array so every chunk knows where its primitives land without locking
+		std::vector<uint32_t> chunkLeftCounts(chunkCount, 0);
+		RunJobs(jobManager, chunkCount, [&](size_t c)
+		{
+			if (splitBins[chunkRanges[c]] < 0) { return; }
+			for (uint32_t i = chunkStarts[c]; i < chunkEnds[c]; ++i)
+			{
+				chunkLeftCounts[c] += goesLeft(chunkRanges[c], _primIndices[i]) ? 1 : 0;
+			}
+		});
+
+		std::vector<uint32_t> rangeLeftCounts(splitting.size(), 0);
+		for (size_t c = 0; c < chunkCount; ++c)
+		{
+			rangeLeftCounts[chunkRanges[c]] += chunkLeftCounts[c];
+		}
+
+		std::vector<uint32_t> chunkLeftWrite(chunkCount);
+		std::vector<uint32_t> chunkRightWrite(chunkCount);
+		std::vector<uint32_t> leftWrite(splitting.size());
+		std::vector<uint32_t> rightWrite(splitting.size());
+		for (uint32_t r = 0; r < splitting.size(); ++r)
+		{
+			leftWrite[r] = splitting[r].start;
+			rightWrite[r] = splitting[r].start + rangeLeftCounts[r];
+		}
+		for (size_t c = 0; c < chunkCount; ++c)
+		{
+			uint32_t r = chunkRanges[c];
+			chunkLeftWrite[c] = leftWrite[r];
+			chunkRightWrite[c] = rightWrite[r];
+			leftWrite[r] += chunkLeftCounts[c];
+			rightWrite[r] += (chunkEnds[c] - chunkStarts[c]) - chunkLeftCounts[c];
+		}
+
+		RunJobs(jobManager, chunkCount, [&](size_t c)
+		{
+			uint32_t r = chunkRanges[c];
+			if (splitBins[r] < 0) { return; }
+			uint32_t left = chunkLeftWrite[c];
+			uint32_t right = chunkRightWrite[c];
+			for (uint32_t i = chunkStarts[c]; i < chunkEnds[c]; ++i)
+			{
+				uint32_t prim = _primIndices[i];
+				scratch[goesLeft(r, prim) ? left++ : right++] = prim;
+			}
+		});
+
+		//Scatter writes across the whole range so copying back has to wait until every chunk of it is done
+		RunJobs(jobManager, chunkCount, [&](size_t c)
+		{
+			if (splitBins[chunkRanges[c]] < 0) { return; }
+			std::copy(&scratch[chunkStarts[c]], &scratch[0] + chunkEnds[c], &_primIndices[chunkStarts[c]]);
+		});
+
+		for (uint32_t r = 0; r < splitting.size(); ++r)
+		{
+			const PendingRange& range = splitting[r];
+			uint32_t mid = range.start + rangeLeftCounts[r];
+			int axis = axes[r];
+
+			//Only happens near the stack limit or when every centroid shares a bin so it is left on the main thread
+			if (splitBins[r] < 0 || mid == range.start || mid == range.end)
+			{
+				mid = range.start + (range.end - range.start) / 2;
+				std::nth_element(&_primIndices[range.start], &_primIndices[mid], &_primIndices[0] + range.end, [&](uint32_t a, uint32_t b)
+				{
+					return prims.centroids[a][axis] < prims.centroids[b][axis];
+				});
+			}
+
+			uint32_t left = static_cast<uint32_t>(topNodes.size());
+			topNodes.resize(topNodes.size() + 2);
+			topNodes[range.top].box = boxes[r];
+			topNodes[range.top].axis = static_cast<uint8_t>(axis);
+			topNodes[range.top].left = left;
+			topNodes[range.top].right = left + 1;
+
+			level.push_back({ range.start, mid, range.depth + 1, left });
+			level.push_back({ mid, range.end, range.depth + 1, left + 1 });
+		}
+	}
+
+	//Everything under the top level is built by the serial builder, each job into its own array as their sizes aren't known up front
+	std::vector<std::vector<Node>> subtreeNodes(subtrees.size());
+	RunJobs(jobManager, subtrees.size(), [&](size_t i)
+	{
+		subtreeNodes[i].reserve((subtrees[i].end - subtrees[i].start) * 2);
+		BuildSahRange(prims, subtrees[i].start, subtrees[i].end, subtrees[i].depth, subtreeNodes[i]);
+	});
+
+	for (size_t i = 0; i < subtrees.size(); ++i)
+	{
+		topNodes[subtrees[i].top].subtree = static_cast<int>(i);
+	}
+
+	EmitTopNode(topNodes, subtreeNodes, 0);
+}
+
+uint32_t LinearBvh::EmitTopNode(const std::vector<TopNode>& topNodes, const std::vector<std::vector<Node>>& subtreeNodes, uint32_t topIndex)
+{
+	const TopNode& top = topNodes[topIndex];
+	uint32_t index = static_cast<uint32_t>(_nodes.size());
+
+	//Subtree child links point into their own array, shift them by where the subtree lands, leaves already index the shared primitive array
+	if (top.subtree >= 0)
+	{
+		for (Node node : subtreeNodes[top.subtree])
+		{
+			node.offset += node.primCount == 0 ? index : 0;
+			_nodes.push_back(node);
+		}
+		return index;
+	}
+
+	_nodes.emplace_back();
+	_nodes[index].box = top.box;
+	_nodes[index].axis = top.axis;
+
+	EmitTopNode(topNodes, subtreeNodes, top.left);
+	uint32_t rightIndex = EmitTopNode(topNodes, subtreeNodes, top.right);
+	_nodes[index].offset = rightIndex;
+
+	return index;
+}
+
+uint32_t LinearBvh::BuildSahRange(const BuildPrims& prims, uint32_t start, uint32_t end, int depth, std::vector<Node>& nodes)
+{
+	uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+
+	AABB box = AABB::Empty();
+	AABB centroidBox = AABB::Empty();
+	for (uint32_t i = start; i < end; ++i)
+	{
+		box.Expand(prims.bounds[_primIndices[i]]);
+		centroidBox.Expand(prims.centroids[_primIndices[i]]);
+	}
+
+	nodes[index].box = box;
+	nodes[index].axis = static_cast<uint8_t>(centroidBox.LongestAxis());
+
+	//Pairs are left to the merge pass afterwards, only a max leaf size of one splits them here
+	uint32_t count = end - start;
+	if (count <= std::min(2u, _maxLeafPrims))
+	{
+		nodes[index].offset = start;
+		nodes[index].primCount = static_cast<uint16_t>(count);
+		return index;
+	}
+
+	int axis = nodes[index].axis;
+	int splitBin = -1;
+	uint32_t mid = start;
+
+	if (!MustSplitOnMedian(count, depth))
+	{
+		SahBins bins;
+		FillSahBins(prims, start, end, centroidBox, bins);
+
+		double splitCost;
+		if (FindSahSplit(bins, count, axis, splitBin, splitCost))
+		{
+			double axisMin = centroidBox.Min()[axis];
+			double binScale = kSahBinCount / (centroidBox.Max()[axis] - axisMin);
+			uint32_t* split = std::partition(&_primIndices[start], &_primIndices[0] + end, [&](uint32_t prim)
+			{
+				int bin = static_cast<int>((prims.centroids[prim][axis] - axisMin) * binScale);
+				return (bin < kSahBinCount ? bin : kSahBinCount - 1) < splitBin;
+			});
+			mid = static_cast<uint32_t>(split - &_primIndices[0]);
+		}
+	}
+
+	//Either every centroid landed in one bin or the depth limit kicked in, fall back to splitting on the median centroid
+	if (mid == start || mid == end)
+	{
+		mid = start + count / 2;
+		std::nth_element(&_primIndices[start], &_primIndices[mid], &_primIndices[0] + end, [&](uint32_t a, uint32_t b)
+		{
+			return prims.centroids[a][axis] < prims.centroids[b][axis];
+		});
+	}
+
+	nodes[index].axis = static_cast<uint8_t>(axis);
+	BuildSahRange(prims, start, mid, depth + 1, nodes);
+	uint32_t rightIndex = BuildSahRange(prims, mid, end, depth + 1, nodes);
+	nodes[index].offset = rightIndex;
+
+	return index;
+}
+
+bool LinearBvh::MustSplitOnMedian(uint32_t count, int depth) const
+{
+	//Work out how many levels a median split would still need, once that would hit the stack limit stop trusting the SAH and halve the range
+	int medianLevels = 0;
+	while ((1u << medianLevels) < count) { ++medianLevels; }
+	return depth + medianLevels >= kMaxStackDepth;
+}
+
+void LinearBvh::FillSahBins(const BuildPrims& prims, uint32_t start, uint32_t end, const AABB& centroidBox, SahBins& bins) const
+{
+	std::array<double, 3> binScales;
+	AA::Vec3 axisMin = centroidBox.Min();
+	AA::Vec3 extent = centroidBox.Max() - axisMin;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		binScales[axis] = extent[axis] > 0.0 ? kSahBinCount / extent[axis] : 0.0;
+	}
+
+	//One pass over the primitives fills the bins for all three axis
+	for (uint32_t i = start; i < end; ++i)
+	{
+		uint32_t prim = _primIndices[i];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			int bin = static_cast<int>((prims.centroids[prim][axis] - axisMin[axis]) * binScales[axis]);
+			bin = bin < kSahBinCount ? bin : kSahBinCount - 1;
+			bins[axis][bin].box.Expand(prims.bounds[prim]);
+			bins[axis][bin].count++;
+		}
+	}
+}
+
+bool LinearBvh::FindSahSplit(const SahBins& bins, uint32_t count, int& outAxis, int& outBin, double& outCost) const
+{
+	double bestCost = INFINITY;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		//Axis with no spread has everything in the first bin, there is no plane to try
+		if (bins[axis][0].count == count) { continue; }
+
+		//Sweep from the right first caching area * count for every possible plane, then sweep from the left and add the two sides together
+		std::array<double, kSahBinCount> rightCosts;
+		AABB sweepBox = AABB::Empty();
+		uint32_t sweepCount = 0;
+		for (int bin = kSahBinCount - 1; bin > 0; --bin)
+		{
+			sweepBox.Expand(bins[axis][bin].box);
+			sweepCount += bins[axis][bin].count;
+			rightCosts[bin] = sweepBox.SurfaceArea() * sweepCount;
+		}
+
+		sweepBox = AABB::Empty();
+		sweepCount = 0;
+		for (int bin = 1; bin < kSahBinCount; ++bin)
+		{
+			sweepBox.Expand(bins[axis][bin - 1].box);
+			sweepCount += bins[axis][bin - 1].count;
+
+			double cost = sweepBox.SurfaceArea() * sweepCount + rightCosts[bin];
+			if (sweepCount > 0 && sweepCount < count && cost < bestCost)
+			{
+				bestCost = cost;
+				outAxis = axis;
+				outBin = bin;
+			}
+		}
+	}
+
+	outCost = bestCost;
+	return bestCost < INFINITY;
+}
+
+void LinearBvh::BuildMorton(const std::vector<Hittable*>& hittables, JobManager* jobManager)
+{
+	uint32_t primCount = static_cast<uint32_t>(hittables.size());
+	JobManager* jobs = jobManager != nullptr && primCount >= kThreadedBuildMinPrims ? jobManager : nullptr;
+
+	BuildPrims prims;
+	GatherBuildPrims(hittables, jobs, prims);
+
+	AABB centroidBox = AABB::Empty();
+	for (const AA::Vec3& centroid : prims.centroids)
+	{
+		centroidBox.Expand(centroid);
+	}
+
+	//Quantise every centroid onto a grid over the centroid bounds and interleave the cells bits, x ends up in the highest bit of each group of three
+	int axisBits = primCount <= kMortonShortCodeMaxPrims ? 10 : 21;
+	double cellCount = static_cast<double>(1u << axisBits);
+	AA::Vec3 axisMin = centroidBox.Min();
+	AA::Vec3 extent = centroidBox.Max() - axisMin;
+	std::array<double, 3> cellScales;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		cellScales[axis] = extent[axis] > 0.0 ? cellCount / extent[axis] : 0.0;
+	}
+
+	std::vector<MortonPrim> mortonPrims(primCount);
+	RunChunks(jobs, primCount, [&](uint32_t start, uint32_t end)
+	{
+		for (uint32_t i = start; i < end; ++i)
+		{
+			uint64_t code = 0;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				double cell = std::min((prims.centroids[i][axis] - axisMin[axis]) * cellScales[axis], cellCount - 1.0);
+				code |= SpreadMortonBits(static_cast<uint64_t>(cell)) << (2 - axis);
+			}
+			mortonPrims[i] = { code, i };
+		}
+	});
+
+	SortMortonPrims(mortonPrims, axisBits * 3, jobs);
+
+	//The sorted order is the final leaf order, the hierarchy only ever splits it into ranges
+	std::vector<uint64_t> codes(primCount);
+	_primIndices.resize(primCount);
+	for (uint32_t i = 0; i < primCount; ++i)
+	{
+		codes[i] = mortonPrims[i].code;
+		_primIndices[i] = mortonPrims[i].prim;
+	}
+	_nodes.reserve(primCount * 2);
+
+	if (jobs == nullptr)
+	{
+		BuildMortonRange(prims, codes, 0, primCount, 1, _nodes);
+		return;
+	}
+
+	//Splits only look at the codes so the top of the tree costs next to nothing, cut it into a couple of subtrees per core and build those as jobs
+	uint32_t workerCount = std::max(std::min<uint32_t>(jobs->GetThreadCount(), std::thread::hardware_concurrency()), 1u);
+	uint32_t subtreeMaxPrims = std::max(primCount / (workerCount * 2), kThreadedSubtreeMinPrims);
+
+	std::vector<TopNode> topNodes(1);
+	std::vector<PendingRange> pending = { { 0, primCount, 1, 0 } };
+	std::vector<PendingRange> subtrees;
+	while (!pending.empty())
+	{
+		PendingRange range = pending.back();
+		pending.pop_back();
+		if (range.end - range.start <= subtreeMaxPrims)
+		{
+			subtrees.push_back(range);
+			continue;
+		}
+
+		uint32_t mid = FindMortonSplit(codes, range.start, range.end, range.depth);
+		uint32_t left = static_cast<uint32_t>(topNodes.size());
+		topNodes.resize(topNodes.size() + 2);
+		topNodes[range.top].left = left;
+		topNodes[range.top].right = left + 1;
+
+		pending.push_back({ range.start, mid, range.depth + 1, left });
+		pending.push_back({ mid, range.end, range.depth + 1, left + 1 });
+	}
+
+	std::vector<std::vector<Node>> subtreeNodes(subtrees.size());
+	RunJobs(jobs, subtrees.size(), [&](size_t i)
+	{
+		subtreeNodes[i].reserve((subtrees[i].end - subtrees[i].start) * 2);
+		BuildMortonRange(prims, codes, subtrees[i].start, subtrees[i].end, subtrees[i].depth, subtreeNodes[i]);
+	});
+
+	for (size_t i = 0; i < subtrees.size(); ++i)
+	{
+		topNodes[subtrees[i].top].subtree = static_cast<int>(i);
+	}
+
+	//Children are always added after their parent so going backwards fills in the top level boxes from the subtrees up
+	for (size_t i = topNodes.size(); i-- > 0;)
+	{
+		TopNode& top = topNodes[i];
+		if (top.subtree >= 0)
+		{
+			top.box = subtreeNodes[top.subtree][0].box;
+		}
+		else
+		{
+			top.box = AABB::SurroundingBox(topNodes[top.left].box, topNodes[top.right].box);
+			top.axis = static_cast<uint8_t>(top.box.LongestAxis());
+		}
+	}
+
+	EmitTopNode(topNodes, subtreeNodes, 0);
+}
+
+void LinearBvh::SortMortonPrims(std::vector<MortonPrim>& mortonPrims, int bitCount, JobManager* jobManager) const
+{
+	const uint32_t bucketCount = 1u << kRadixBits;
+	uint32_t primCount = static_cast<uint32_t>(mortonPrims.size());
+	uint32_t chunkCount = jobManager != nullptr ? (primCount + kThreadedChunkSize - 1) / kThreadedChunkSize : 1;
+	uint32_t chunkSize = jobManager != nullptr ? kThreadedChunkSize : primCount;
+
+	std::vector<MortonPrim> scratch(primCount);
+	std::vector<uint32_t> chunkCounts(chunkCount * bucketCount);
+
+	//Least significant digit first, each pass is stable so the order from the lower digits survives the higher ones
+	for (int shift = 0; shift < bitCount; shift += kRadixBits)
+	{
+		std::fill(chunkCounts.begin(), chunkCounts.end(), 0);
+		RunChunks(jobManager, primCount, [&](uint32_t start, uint32_t end)
+		{
+			uint32_t* counts = &chunkCounts[start / chunkSize * bucketCount];
+			for (uint32_t i = start; i < end; ++i)
+			{
+				counts[(mortonPrims[i].code >> shift) & (bucketCount - 1)]++;
+			}
+		});
+
+		//Turn the counts into write positions, bucket by bucket and chunk by chunk inside each bucket to keep it stable
+		uint32_t writePos = 0;
+		bool singleBucket = false;
+		for (uint32_t bucket = 0; bucket < bucketCount; ++bucket)
+		{
+			uint32_t bucketStart = writePos;
+			for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+			{
+				uint32_t count = chunkCounts[chunk * bucketCount + bucket];
+				chunkCounts[chunk * bucketCount + bucket] = writePos;
+				writePos += count;
+			}
+			singleBucket |= writePos - bucketStart == primCount;
+		}
+
+		//Every code has the same digit here, the pass wouldn't move anything
+		if (singleBucket)
+		{
+			continue;
+		}
+
+		RunChunks(jobManager, primCount, [&](uint32_t start, uint32_t end)
+		{
+			uint32_t* writePositions = &chunkCounts[start / chunkSize * bucketCount];
+			for (uint32_t i = start; i < end; ++i)
+			{
+				scratch[writePositions[(mortonPrims[i].code >> shift) & (bucketCount - 1)]++] = mortonPrims[i];
+			}
+		});
+		mortonPrims.swap(scratch);
+	}
+}
+
+uint32_t LinearBvh::BuildMortonRange(const BuildPrims& prims, const std::vector<uint64_t>& codes, uint32_t start, uint32_t end, int depth, std::vector<Node>& nodes) const
+{
+	uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+
+	uint32_t count = end - start;
+	if (count <= std::min(2u, _maxLeafPrims))
+	{
+		AABB box = AABB::Empty();
+		for (uint32_t i = start; i < end; ++i)
+		{
+			box.Expand(prims.bounds[_primIndices[i]]);
+		}
+		nodes[index].box = box;
+		nodes[index].axis = static_cast<uint8_t>(box.LongestAxis());
+		nodes[index].offset = start;
+		nodes[index].primCount = static_cast<uint16_t>(count);
+		return index;
+	}
+
+	uint32_t mid = FindMortonSplit(codes, start, end, depth);
+	BuildMortonRange(prims, codes, start, mid, depth + 1, nodes);
+	uint32_t rightIndex = BuildMortonRange(prims, codes, mid, end, depth + 1, nodes);
+
+	//Boxes come from the children on the way back up so each primitive's bounds are only read once
+	nodes[index].box = AABB::SurroundingBox(nodes[index + 1].box, nodes[rightIndex].box);
+	nodes[index].axis = static_cast<uint8_t>(nodes[index].box.LongestAxis());
+	nodes[index].offset = rightIndex;
+	return index;
+}
+
+uint32_t LinearBvh::FindMortonSplit(const std::vector<uint64_t>& codes, uint32_t start, uint32_t end, int depth) const
+{
+	//Shared codes have no bit to split on and the stack limit needs a balanced split, both just halve the range
+	uint64_t differentBits = codes[start] ^ codes[end - 1];
+	if (differentBits == 0 || MustSplitOnMedian(end - start, depth))
+	{
+		return start + (end - start) / 2;
+	}
+
+	//Everything in a sorted range shares the bits above the highest one that differs between its ends, so that bit is 0 up to the split and 1 after it
+	uint64_t splitBit = differentBits;
+	while ((splitBit & (splitBit - 1)) != 0)
+	{
+		splitBit &= splitBit - 1;
+	}
+
+	const uint64_t* split = std::partition_point(&codes[start], &codes[0] + end, [splitBit](uint64_t code)
+	{
+		return (code & splitBit) == 0;
+	});
+	return static_cast<uint32_t>(split - &codes[0]);
+}
+
+void LinearBvh::BuildSpatialSah(const std::vector<Hittable*>& hittables)
+{
+	//Every primitive starts as one reference covering all of it, tight bounds as the clipping works on the real shape anyway
+	std::vector<SpatialRef> refs;
+	refs.reserve(hittables.size());
+	AABB rootBox = AABB::Empty();
+	for (uint32_t i = 0; i < hittables.size(); ++i)
+	{
+		SpatialRef ref = { AABB::Empty(), i };
+		if (!hittables[i]->TightBoundingBox(ref.box))
+		{
+			hittables[i]->BoundingBox(0.0, 0.0, ref.box);
+		}
+		rootBox.Expand(ref.box);
+		refs.push_back(ref);
+	}
+
+	_nodes.reserve(hittables.size() * 3);
+	_primIndices.reserve(hittables.size() * 2);
+	BuildSpatialRange(hittables, refs, 1, _spatialSplitAlpha * rootBox.SurfaceArea());
+}
+
+uint32_t LinearBvh::BuildSpatialRange(const std::vector<Hittable*>& hittables, std::vector<SpatialRef>& refs, int depth, double minOverlap)
+{
+	uint32_t index = static_cast<uint32_t>(_nodes.size());
+	_nodes.emplace_back();
+
+	AABB box = AABB::Empty();
+	AABB centroidBox = AABB::Empty();
+	for (const SpatialRef& ref : refs)
+	{
+		box.Expand(ref.box);
+		centroidBox.Expand(ref.box.Centroid());
+	}
+
+	_nodes[index].box = box;
+	int axis = centroidBox.LongestAxis();
+	_nodes[index].axis = static_cast<uint8_t>(axis);
+
+	//Leaves are written out as they're reached so every subtree's references end up next to each other in the index array
+	uint32_t count = static_cast<uint32_t>(refs.size());
+	if (count <= std::min(2u, _maxLeafPrims))
+	{
+		_nodes[index].offset = static_cast<uint32_t>(_primIndices.size());
+		_nodes[index].primCount = static_cast<uint16_t>(count);
+		for (const SpatialRef& ref : refs)
+		{
+			_primIndices.push_back(ref.prim);
+		}
+		return index;
+	}
+
+	std::vector<SpatialRef> left;
+	std::vector<SpatialRef> right;
+
+	if (!MustSplitOnMedian(count, depth))
+	{
+		//Object split first, binned on the reference centroids exactly like the plain SAH build
+		SahBins bins;
+		std::array<double, 3> binScales;
+		AA::Vec3 axisMin = centroidBox.Min();
+		AA::Vec3 extent = centroidBox.Max() - axisMin;
+		for (int a = 0; a < 3; ++a)
+		{
+			binScales[a] = extent[a] > 0.0 ? kSahBinCount / extent[a] : 0.0;
+		}
+		auto binOf = [&](const SpatialRef& ref, int a)
+		{
+			int bin = static_cast<int>((ref.box.Centroid()[a] - axisMin[a]) * binScales[a]);
+			return bin < kSahBinCount ? bin : kSahBinCount - 1;
+		};
+		for (const SpatialRef& ref : refs)
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				bins[a][binOf(ref, a)].box.Expand(ref.box);
+				bins[a][binOf(ref, a)].count++;
+			}
+		}
+
+		int objectAxis = axis;
+		int objectBin = -1;
+		double objectCost = INFINITY;
+		bool hasObjectSplit = FindSahSplit(bins, count, objectAxis, objectBin, objectCost);
+
+		//Only pay for the spatial search where the object split leaves its children overlapping
+		double overlap = INFINITY;
+		if (hasObjectSplit)
+		{
+			AABB leftBox = AABB::Empty();
+			AABB rightBox = AABB::Empty();
+			for (int bin = 0; bin < kSahBinCount; ++bin)
+			{
+				(bin < objectBin ? leftBox : rightBox).Expand(bins[objectAxis][bin].box);
+			}
+			AABB overlapBox = AABB::Intersection(leftBox, rightBox);
+			overlap = overlapBox.IsEmpty() ? 0.0 : overlapBox.SurfaceArea();
+		}
+
+		int spatialAxis = 0;
+		double spatialPlane = 0.0;
+		double spatialCost = INFINITY;
+		if (overlap > minOverlap && FindSpatialSplit(hittables, refs, box, spatialAxis, spatialPlane, spatialCost) && spatialCost < objectCost)
+		{
+			SplitSpatialRefs(hittables, refs, spatialAxis, spatialPlane, left, right);
+
+			//Every reference straddling the plane would hand both children the whole node again
+			if (left.size() == count && right.size() == count)
+			{
+				left.clear();
+				right.clear();
+			}
+			else
+			{
+				axis = spatialAxis;
+			}
+		}
+
+		if (left.empty() && hasObjectSplit)
+		{
+			for (const SpatialRef& ref : refs)
+			{
+				(binOf(ref, objectAxis) < objectBin ? left : right).push_back(ref);
+			}
+			axis = objectAxis;
+		}
+	}
+
+	//Either every centroid landed in one bin or the depth limit kicked in, fall back to splitting on the median centroid
+	if (left.empty() || right.empty())
+	{
+		left.clear();
+		right.clear();
+		uint32_t mid = count / 2;
+		std::nth_element(refs.begin(), refs.begin() + mid, refs.end(), [axis](const SpatialRef& a, const SpatialRef& b)
+		{
+			return a.box.Centroid()[axis] < b.box.Centroid()[axis];
+		});
+		left.assign(refs.begin(), refs.begin() + mid);
+		right.assign(refs.begin() + mid, refs.end());
+	}
+
+	//Nothing above needs these once they're shared out, free them before going deeper
+	std::vector<SpatialRef>().swap(refs);
+
+	_nodes[index].axis = static_cast<uint8_t>(axis);
+	BuildSpatialRange(hittables, left, depth + 1, minOverlap);
+	uint32_t rightIndex = BuildSpatialRange(hittables, right, depth + 1, minOverlap);
+	_nodes[index].offset = rightIndex;
+
+	return index;
+}
+
+bool LinearBvh::FindSpatialSplit(const std::vector<Hittable*>& hittables, const std::vector<SpatialRef>& refs, const AABB& box, int& outAxis, double& outPlane, double& outCost) const
+{
+	double bestCost = INFINITY;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		double axisMin = box.Min()[axis];
+		double binWidth = (box.Max()[axis] - axisMin) / kSpatialBinCount;
+		if (binWidth <= 0.0) { continue; }
+
+		//Every reference is clipped into each slice it touches, entries and exits count where it starts and ends so the sweep knows which side it's on
+		std::array<AABB, kSpatialBinCount> binBoxes;
+		binBoxes.fill(AABB::Empty());
+		std::array<uint32_t, kSpatialBinCount> entries = {};
+		std::array<uint32_t, kSpatialBinCount> exits = {};
+
+		auto binOf = [&](double position)
+		{
+			int bin = static_cast<int>((position - axisMin) / binWidth);
+			return std::max(0, std::min(bin, kSpatialBinCount - 1));
+		};
+
+		for (const SpatialRef& ref : refs)
+		{
+			int first = binOf(ref.box.Min()[axis]);
+			int last = binOf(ref.box.Max()[axis]);
+			entries[first]++;
+			exits[last]++;
+
+			if (first == last)
+			{
+				binBoxes[first].Expand(ref.box);
+				continue;
+			}
+
+			for (int bin = first; bin <= last; ++bin)
+			{
+				double slabMin = bin == first ? -INFINITY : axisMin + bin * binWidth;
+				double slabMax = bin == last ? INFINITY : axisMin + (bin + 1) * binWidth;
+				AABB clipped;
+				if (ClipRef(hittables, ref, axis, slabMin, slabMax, clipped))
+				{
+					binBoxes[bin].Expand(clipped);
+				}
+			}
+		}
+
+		//Same two sweeps as the object split, the left side counts references starting before the plane and the right side ones ending after it
+		std::array<double, kSpatialBinCount> rightCosts;
+		AABB sweepBox = AABB::Empty();
+		uint32_t sweepCount = 0;
+		for (int bin = kSpatialBinCount - 1; bin > 0; --bin)
+		{
+			sweepBox.Expand(binBoxes[bin]);
+			sweepCount += exits[bin];
+			rightCosts[bin] = sweepCount > 0 ? sweepBox.SurfaceArea() * sweepCount : INFINITY;
+		}
+
+		sweepBox = AABB::Empty();
+		sweepCount = 0;
+		for (int bin = 1; bin < kSpatialBinCount; ++bin)
+		{
+			sweepBox.Expand(binBoxes[bin - 1]);
+			sweepCount += entries[bin - 1];
+
+			double cost = sweepBox.SurfaceArea() * sweepCount + rightCosts[bin];
+			if (sweepCount > 0 && cost < bestCost)
+			{
+				bestCost = cost;
+				outAxis = axis;
+				outPlane = axisMin + bin * binWidth;
+			}
+		}
+	}
+
+	outCost = bestCost;
+	return bestCost < INFINITY;
+}
+
+void LinearBvh::SplitSpatialRefs(const std::vector<Hittable*>& hittables, const std::vector<SpatialRef>& refs, int axis, double plane, std::vector<SpatialRef>& outLeft, std::vector<SpatialRef>& outRight) const
+{
+	for (const SpatialRef& ref : refs)
+	{
+		if (ref.box.Max()[axis] <= plane)
+		{
+			outLeft.push_back(ref);
+			continue;
+		}
+		if (ref.box.Min()[axis] >= plane)
+		{
+			outRight.push_back(ref);
+			continue;
+		}
+
+		//Straddles the plane, each side gets its own reference clipped to just its half. A half can vanish when the shape misses the part of its box over there
+		SpatialRef leftRef = { AABB::Empty(), ref.prim };
+		SpatialRef rightRef = { AABB::Empty(), ref.prim };
+		bool inLeft = ClipRef(hittables, ref, axis, -INFINITY, plane, leftRef.box);
+		bool inRight = ClipRef(hittables, ref, axis, plane, INFINITY, rightRef.box);
+		if (inLeft)
+		{
+			outLeft.push_back(leftRef);
+		}
+		if (inRight)
+		{
+			outRight.push_back(rightRef);
+		}
+
+		//Rounding can lose a sliver that only touches the plane, never let the whole reference go with it
+		if (!inLeft && !inRight)
+		{
+			outLeft.push_back(ref);
+		}
+	}
+}
+
+bool LinearBvh::ClipRef(const std::vector<Hittable*>& hittables, const SpatialRef& ref, int axis, double slabMin, double slabMax, AABB& outBox) const
+{
+	//The reference may already be cut down on other axis so the clipped primitive is kept inside what it covered before
+	AABB clipped;
+	if (!hittables[ref.prim]->ClippedBoundingBox(axis, slabMin, slabMax, clipped))
+	{
+		return false;
+	}
+
+	outBox = AABB::Intersection(clipped, ref.box);
+	return !outBox.IsEmpty();
+}
+
+void LinearBvh::OptimiseTreelets(JobManager* jobManager)
+{
+	if (_nodes.size() < 5)
+	{
+		return;
+	}
+
+	TreeletTree tree;
+	tree.nodes = _nodes;
+	tree.left.resize(_nodes.size(), 0);
+	tree.costs.resize(_nodes.size(), 0.0);
+	for (size_t i = _nodes.size(); i-- > 0;)
+	{
+		const Node& node = _nodes[i];
+		double area = node.box.SurfaceArea();
+		if (node.primCount > 0)
+		{
+			tree.costs[i] = area * node.primCount * kSahPrimCost;
+			continue;
+		}
+
+		tree.left[i] = static_cast<uint32_t>(i + 1);
+		tree.costs[i] = area * kSahNodeCost + tree.costs[i + 1] + tree.costs[node.offset];
+	}
+
+	for (uint32_t pass = 0; pass < _treeletPasses; ++pass)
+	{
+		//Opens up the biggest subtrees from the root until there are enough to go round the threads, restructuring never moves a node out of its subtree so they can't clash
+		std::vector<uint32_t> topNodes;
+		std::vector<uint32_t> subtrees = { 0 };
+		uint32_t jobCount = jobManager != nullptr ? kTreeletJobCount : 1;
+		while (subtrees.size() < jobCount)
+		{
+			auto biggest = subtrees.end();
+			for (auto it = subtrees.begin(); it != subtrees.end(); ++it)
+			{
+				if (tree.nodes[*it].primCount == 0 && (biggest == subtrees.end() || tree.costs[*it] > tree.costs[*biggest]))
+				{
+					biggest = it;
+				}
+			}
+			if (biggest == subtrees.end())
+			{
+				break;
+			}
+
+			uint32_t index = *biggest;
+			subtrees.erase(biggest);
+			subtrees.push_back(tree.left[index]);
+			subtrees.push_back(tree.nodes[index].offset);
+			topNodes.push_back(index);
+		}
+
+		if (jobManager != nullptr)
+		{
+			RunJobs(jobManager, subtrees.size(), [&](size_t i) { OptimiseTreeletSubtree(tree, subtrees[i]); });
+		}
+		else
+		{
+			for (uint32_t root : subtrees)
+			{
+				OptimiseTreeletSubtree(tree, root);
+			}
+		}
+
+		//Nodes were opened parents first so going backwards finishes every child before its parent
+		for (auto it = topNodes.rbegin(); it != topNodes.rend(); ++it)
+		{
+			RestructureTreelet(tree, *it);
+		}
+	}
+
+	//Write the tree back out depth first, the leaves' primitives are copied along with them so every subtree's range is contiguous again for the merge
+	std::vector<Node> builtNodes;
+	builtNodes.swap(_nodes);
+	_nodes.reserve(builtNodes.size());
+	std::vector<uint32_t> primIndices;
+	primIndices.reserve(_primIndices.size());
+
+	int maxDepth = 0;
+	EmitTreeletNode(tree, 0, 1, maxDepth, primIndices);
+
+	//Cheaper trees can be deeper ones, keep the tree from the build rather than overflow the traversal stack
+	if (maxDepth > kMaxStackDepth)
+	{
+		_nodes.swap(builtNodes);
+		return;
+	}
+	_primIndices.swap(primIndices);
+}
+
+void LinearBvh::OptimiseTreeletSubtree(TreeletTree& tree, uint32_t root) const
+{
+	//Reversed depth first order reaches every node after everything under it
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> stack = { root };
+	while (!stack.empty())
+	{
+		uint32_t index = stack.back();
+		stack.pop_back();
+		if (tree.nodes[index].primCount > 0)
+		{
+			continue;
+		}
+
+		order.push_back(index);
+		stack.push_back(tree.nodes[index].offset);
+		stack.push_back(tree.left[index]);
+	}
+
+	for (auto it = order.rbegin(); it != order.rend(); ++it)
+	{
+		RestructureTreelet(tree, *it);
+	}
+}
+
+void LinearBvh::RestructureTreelet(TreeletTree& tree, uint32_t root) const
+{
+	//Grow the treelet down from the root by opening whichever of its leaves has the largest surface area, it's the one rays reach most
+	std::array<uint32_t, kTreeletLeaves> leaves;
+	std::array<uint32_t, kTreeletLeaves - 1> interiors;
+	uint32_t leafCount = 2;
+	uint32_t interiorCount = 1;
+	leaves[0] = tree.left[root];
+	leaves[1] = tree.nodes[root].offset;
+	interiors[0] = root;
+
+	while (leafCount < kTreeletLeaves)
+	{
+		int biggest = -1;
+		double biggestArea = -1.0;
+		for (uint32_t i = 0; i < leafCount; ++i)
+		{
+			const Node& node = tree.nodes[leaves[i]];
+			double area = node.box.SurfaceArea();
+			if (node.primCount == 0 && area > biggestArea)
+			{
+				biggest = static_cast<int>(i);
+				biggestArea = area;
+			}
+		}
+		if (biggest < 0)
+		{
+			break;
+		}
+
+		uint32_t opened = leaves[biggest];
+		interiors[interiorCount++] = opened;
+		leaves[biggest] = tree.left[opened];
+		leaves[leafCount++] = tree.nodes[opened].offset;
+	}
+
+	//Two leaves only fit together one way
+	if (leafCount < 3)
+	{
+		return;
+	}
+
+	//Best tree over every subset of the leaves, subsets are built from smaller ones which always come first counting up
+	const uint32_t subsetCount = 1u << leafCount;
+	std::array<AABB, 1u << kTreeletLeaves> boxes;
+	std::array<double, 1u << kTreeletLeaves> costs;
+	std::array<uint8_t, 1u << kTreeletLeaves> splits;
+
+	for (uint32_t set = 1; set < subsetCount; ++set)
+	{
+		uint32_t lowest = set & (~set + 1);
+		if (set == lowest)
+		{
+			uint32_t leaf = leaves[LowestBitIndex(lowest)];
+			boxes[set] = tree.nodes[leaf].box;
+			costs[set] = tree.costs[leaf];
+			continue;
+		}
+
+		boxes[set] = boxes[set ^ lowest];
+		boxes[set].Expand(boxes[lowest]);
+
+		//Only partitions holding the lowest leaf on the left are tried, the mirror image costs the same
+		double bestCost = INFINITY;
+		uint8_t bestSplit = 0;
+		for (uint32_t part = (set - 1) & set; part != 0; part = (part - 1) & set)
+		{
+			if ((part & lowest) == 0)
+			{
+				continue;
+			}
+
+			double cost = costs[part] + costs[set ^ part];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = static_cast<uint8_t>(part);
+			}
+		}
+		costs[set] = boxes[set].SurfaceArea() * kSahNodeCost + bestCost;
+		splits[set] = bestSplit;
+	}
+
+	//Small margin so rounding can't keep swapping between two shapes that cost the same
+	const uint32_t allLeaves = subsetCount - 1;
+	if (costs[allLeaves] >= tree.costs[root] * (1.0 - 1e-9))
+	{
+		return;
+	}
+
+	//Rebuild the chosen shape reusing the treelet's interior nodes, the root stays where it is so the parent doesn't need to know
+	uint32_t nextInterior = 0;
+	std::function<uint32_t(uint32_t)> emit = [&](uint32_t set) -> uint32_t
+	{
+		if ((set & (set - 1)) == 0)
+		{
+			return leaves[LowestBitIndex(set)];
+		}
+
+		uint32_t index = interiors[nextInterior++];
+		uint32_t leftIndex = emit(splits[set]);
+		uint32_t rightIndex = emit(set ^ splits[set]);
+
+		Node& node = tree.nodes[index];
+		node.box = boxes[set];
+		node.offset = rightIndex;
+		node.axis = static_cast<uint8_t>(node.box.LongestAxis());
+		tree.left[index] = leftIndex;
+		tree.costs[index] = costs[set];
+		return index;
+	};
+	emit(allLeaves);
+}
+
+uint32_t LinearBvh::EmitTreeletNode(const TreeletTree& tree, uint32_t index, int depth, int& maxDepth, std::vector<uint32_t>& primIndices)
+{
+	maxDepth = std::max(maxDepth, depth);
+	uint32_t newIndex = static_cast<uint32_t>(_nodes.size());
+	_nodes.push_back(tree.nodes[index]);
+
+	Node& node = _nodes[newIndex];
+	if (node.primCount > 0)
+	{
+		uint32_t first = node.offset;
+		node.offset = static_cast<uint32_t>(primIndices.size());
+		primIndices.insert(primIndices.end(), _primIndices.begin() + first, _primIndices.begin() + first + node.primCount);
+		return newIndex;
+	}
+
+	EmitTreeletNode(tree, tree.left[index], depth + 1, maxDepth, primIndices);
+	uint32_t rightIndex = EmitTreeletNode(tree, tree.nodes[index].offset, depth + 1, maxDepth, primIndices);
+	_nodes[newIndex].offset = rightIndex;
+	return newIndex;
+}
+
+void LinearBvh::MergeSmallSubtrees()
+{
+	if (_nodes.size() < 3 || _maxLeafPrims < 2)
+	{
+		return;
+	}
+
+	//Bottom up pass working out what each subtree costs as it is and as a single leaf, costs are left unnormalised by the root area
+	//Every builder leaves a subtree's primitives next to each other in the index array so a merged leaf can just cover the range
+	std::vector<uint32_t> primCounts(_nodes.size());
+	std::vector<uint32_t> firstPrims(_nodes.size());
+	std::vector<double> costs(_nodes.size());
+	std::vector<uint8_t> merge(_nodes.size(), 0);
+	bool anyMerged = false;
+
+	for (size_t i = _nodes.size(); i-- > 0;)
+	{
+		const Node& node = _nodes[i];
+		double area = node.box.SurfaceArea();
+		if (node.primCount > 0)
+		{
+			primCounts[i] = node.primCount;
+			firstPrims[i] = node.offset;
+			costs[i] = area * node.primCount * kSahPrimCost;
+			continue;
+		}
+
+		uint32_t left = static_cast<uint32_t>(i + 1);
+		uint32_t right = node.offset;
+		primCounts[i] = primCounts[left] + primCounts[right];
+		firstPrims[i] = firstPrims[left];
+		costs[i] = area * kSahNodeCost + costs[left] + costs[right];
+
+		double leafCost = area * primCounts[i] * kSahPrimCost;
+		bool contiguous = firstPrims[right] == firstPrims[left] + primCounts[left];
+		if (contiguous && primCounts[i] <= _maxLeafPrims && leafCost <= costs[i])
+		{
+			merge[i] = 1;
+			costs[i] = leafCost;
+			anyMerged = true;
+		}
+	}
+
+	if (!anyMerged)
+	{
+		return;
+	}
+
+	std::vector<Node> nodes;
+	nodes.swap(_nodes);
+	_nodes.reserve(nodes.size());
+	EmitMergedNode(nodes, merge, primCounts, 0);
+}
+
+uint32_t LinearBvh::EmitMergedNode(const std::vector<Node>& nodes, const std::vector<uint8_t>& merge, const std::vector<uint32_t>& primCounts, uint32_t index)
+{
+	uint32_t newIndex = static_cast<uint32_t>(_nodes.size());
+	_nodes.push_back(nodes[index]);
+	if (nodes[index].primCount > 0)
+	{
+		return newIndex;
+	}
+
+	//A merged node takes over the whole range of the leaves under it, its leftmost leaf starts the range
+	if (merge[index])
+	{
+		uint32_t leftmost = index;
+		while (nodes[leftmost].primCount == 0)
+		{
+			++leftmost;
+		}
+		_nodes[newIndex].offset = nodes[leftmost].offset;
+		_nodes[newIndex].primCount = static_cast<uint16_t>(primCounts[index]);
+		return newIndex;
+	}
+
+	EmitMergedNode(nodes, merge, primCounts, index + 1);
+	uint32_t rightIndex = EmitMergedNode(nodes, merge, primCounts, nodes[index].offset);
+	_nodes[newIndex].offset = rightIndex;
+	return newIndex;
+}
+
+void LinearBvh::Clear()
+{
+	_nodes.clear();
+	_primIndices.clear();
+	_primCount = 0;
+	_builtSahCost = 0.0;
+	_wideBvh.Clear();
+}
+
+uint32_t LinearBvh::FlattenNode(Hittable* node, const std::unordered_map<const Hittable*, uint32_t>& lookup, int depth, int& maxDepth)
+{
+	maxDepth = depth > maxDepth ? depth : maxDepth;
+
+	//Anything found in the lookup is one of the original hittables, everything else was made by the BvhNode builder
+	if (lookup.count(node) > 0)
+	{
+		return AddLeaf({ node }, lookup);
+	}
+
+	BvhNode* bvhNode = static_cast<BvhNode*>(node);
+	Hittable* left = bvhNode->_left;
+	Hittable* right = bvhNode->_right;
+	bool leftIsPrim = lookup.count(left) > 0;
+	bool rightIsPrim = lookup.count(right) > 0;
+
+	//Two primitives under one node collapse into a single leaf, the builder stores a lone primitive as both children so only keep one copy
+	if (leftIsPrim && rightIsPrim)
+	{
+		return left == right ? AddLeaf({ left }, lookup) : AddLeaf({ left, right }, lookup);
+	}
+
+	uint32_t index = static_cast<uint32_t>(_nodes.size());
+	_nodes.emplace_back();
+	_nodes[index].box = bvhNode->_box;
+	_nodes[index].axis = static_cast<uint8_t>(bvhNode->_box.LongestAxis());
+
+	FlattenNode(left, lookup, depth + 1, maxDepth);
+	uint32_t rightIndex = FlattenNode(right, lookup, depth + 1, maxDepth);
+	_nodes[index].offset = rightIndex;
+
+	//The builder allocated these and nothing else references them once they're flattened
+	if (!leftIsPrim) { delete left; }
+	if (!rightIsPrim) { delete right; }
+
+	return index;
+}
+
+uint32_t LinearBvh::AddLeaf(std::initializer_list<const Hittable*> prims, const std::unordered_map<const Hittable*, uint32_t>& lookup)
+{
+	uint32_t index = static_cast<uint32_t>(_nodes.size());
+	Node leaf;
+	leaf.offset = static_cast<uint32_t>(_primIndices.size());
+	leaf.primCount = static_cast<uint16_t>(prims.size());
+
+	bool first = true;
+	for (const Hittable* prim : prims)
+	{
+		AABB primBox;
+		prim->BoundingBox(0.0, 0.0, primBox);
+		leaf.box = first ? primBox : AABB::SurroundingBox(leaf.box, primBox);
+		first = false;
+
+		_primIndices.push_back(lookup.at(prim));
+	}
+
+	leaf.axis = static_cast<uint8_t>(leaf.box.LongestAxis());
+	_nodes.push_back(leaf);
+	return index;
+}
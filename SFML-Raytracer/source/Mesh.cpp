@@ -1,285 +1,198 @@
 #include "..\include\Mesh.h"
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
-#include <iostream>
-#include <unordered_map>
+#include "Light.h"
+#include "Material.h"
+#include "BvhStats.h"
 
-Mesh::Mesh(const char* modelPath, const char* texturePath, AA::Vec3 position, AA::Vec3 scale, bool isStatic, Material* mat, bool useBvh, bool useSmart, ModelParams param, Light* sceneLight)
-	: Hittable(isStatic, mat, sceneLight),  _position(position), _scale(scale), _useBvh(useBvh), _useSah(useSmart)
+Mesh::Mesh(const char* modelPath, const char* texturePath, AA::Vec3 position, AA::Vec3 scale, bool isStatic, Material* mat, bool useBvh, bool useSmart, ModelParams param, Light* sceneLight, JobManager* jobManager, bool useSpatialSplits)
+	: Hittable(isStatic, mat, sceneLight),  _position(position), _scale(scale)
 {
-	LoadTexture(texturePath);
-	LoadModel(modelPath, param);
-	UpdateTrisPosition();
-	UpdateTrisScale();
-
-	if (_useBvh)
-	{
-		_meshBvh = std::make_unique<BvhNode>(_tris, 0.0, 0.0, _useSah);
-	}
+	_data = MeshData::Get(modelPath, texturePath, param, useBvh, useSmart, useSpatialSplits, jobManager);
 }
 
 Mesh::~Mesh()
 {
-	for (auto& hit : _tris)
-	{
-		delete hit;
-	}
 }
 
 bool Mesh::IntersectedRay(const AA::Ray& ray, double t_min, double t_max, HitResult& res)
 {
-	if (_tris.size() == 0)
+	if (!IntersectTris(ToObjectSpace(ray), t_min, t_max, res, true))
 	{
 		return false;
 	}
 
-	Hittable::HitResult tempRes;
-	bool didHit = false;
-	double closestHit = t_max;
+	//Back out of object space, the cross product normal scales by the inverse scale times its determinant
+	res.p = ray.GetPointAlongRay(res.t);
+	res.normal = res.normal / _scale * (_scale.X() * _scale.Y() * _scale.Z());
 
-	////With BVH
-	//Create a bvh of the hittables, then do the iterations of the ray against the bvh intersect ray
-	if (_useBvh)
+	//The triangles are shared so they only hand back the texture or normal colour, this instance's material decides the final one
+	res.mat = _material.get();
+	if (_data->HasTexture() || !_material->MaterialActive())
 	{
-		//If the objects can move then we need to remake the bvh, TODO Set a dirty flag later so this isnt done everyyyyy update
-		if (!_isStatic || !_meshBvh->IsConstructed())
-		{
-			_meshBvh->ConstructBVH(_tris, 0.0, 0.0, _useSah);
-		}
-		didHit = _meshBvh->IntersectedRay(ray, t_min, t_max, tempRes);
-
-		if (didHit)
-		{
-			res = tempRes;
-		}
+		_material->SetColour(res.col);
 	}
+	res.col = _material->GetColour();
 
-	//// Without BVH
-	else
+	//Lighting needs the world space hit so it happens here once for the closest triangle
+	if (_sceneLight != nullptr)
 	{
-		for (auto& hitt : _tris)
-		{
-			if (hitt->IntersectedRay(ray, t_min, closestHit, tempRes))
-			{
-				didHit = true;
-				closestHit = tempRes.t;
-				res = tempRes;
-			}
-		}
+		_sceneLight->CalculateLighting(ray, res);
 	}
-
-	return didHit;
+	return true;
 }
 
 bool Mesh::IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max, HitResult& res)
 {
-	if (_tris.size() == 0)
+	if (!IntersectTris(ToObjectSpace(ray), t_min, t_max, res, false))
 	{
 		return false;
 	}
 
+	res.mat = _material.get();
+	return true;
+}
+
+bool Mesh::Occluded(const AA::Ray& ray, double t_min, double t_max)
+{
+	const TriangleStore& store = _data->GetStore();
+	AA::Ray objectRay = ToObjectSpace(ray);
+	auto occludes = [&](uint32_t triIndex)
+	{
+		double t, u, v;
+		return store.Intersect(triIndex, objectRay, t_min, t_max, t, u, v) && t > AA::kHitEpsilon;
+	};
+
 	////With BVH
-	//Create a bvh of the hittables, then do the iterations of the ray against the bvh intersect ray
-	if (_useBvh)
+	//Any hit in the leaf will do but the batched closest hit test is still the quickest way through it
+	if (_data->GetBvh() != nullptr)
 	{
-		//If the objects can move then we need to remake the bvh, TODO Set a dirty flag later so this isnt done everyyyyy update
-		if (!_isStatic || !_meshBvh->IsConstructed())
+		double hitMin = std::max(t_min, static_cast<double>(AA::kHitEpsilon));
+		return _data->GetBvh()->TraverseAnyLeaves(objectRay, t_min, t_max, [&](const uint32_t* triIndices, uint32_t triCount)
 		{
-			_meshBvh->ConstructBVH(_tris, 0.0, 0.0, _useSah);
-		}
-		return _meshBvh->IntersectedRayOnly(ray, t_min, t_max, res);
+			uint32_t index;
+			double t, u, v;
+			return store.IntersectNearest(triIndices, triCount, objectRay, hitMin, t_max, index, t, u, v);
+		});
 	}
 
 	//// Without BVH
-	else
+	for (uint32_t i = 0; i < store.Size(); ++i)
 	{
-		for (auto& hitt : _tris)
+		if (occludes(i))
 		{
-			if (hitt->IntersectedRayOnly(ray, t_min, t_max, res))
-			{
-				return true;
-			}
+			return true;
 		}
 	}
-
 	return false;
 }
 
-bool Mesh::LoadModel(const char* path, ModelParams param)
+bool Mesh::IntersectTris(const AA::Ray& objectRay, double t_min, double t_max, HitResult& res, bool closestOnly) const
 {
-	tinyobj::attrib_t attributes;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn, err;
-
-	if (!tinyobj::LoadObj(&attributes, &shapes, &materials, &warn, &err, path))
+	const TriangleStore& store = _data->GetStore();
+	if (store.Size() == 0)
 	{
-		std::cout << "Error loading Obj! Info below:" << std::endl << "Warning: " << warn << std::endl << "Error: " << err << std::endl;
 		return false;
 	}
 
-	std::unordered_map<AA::Vertex, uint32_t> uniqueVerts = {};
-	std::vector<AA::Vertex> verts;
-	std::vector<uint32_t> inds;
-
-	for (const auto& shape : shapes)
+	//The tests only read the store, the closest triangle itself is only touched once at the end to shade the hit
+	uint32_t hitIndex = UINT32_MAX;
+	double hitT = t_max;
+	double hitU = 0.0;
+	double hitV = 0.0;
+	auto testTri = [&](uint32_t triIndex, double& closest)
 	{
-		if (shape.mesh.indices.size() % 3 != 0)
+		double t, u, v;
+		if (store.Intersect(triIndex, objectRay, t_min, closest, t, u, v) && (closestOnly || t > AA::kHitEpsilon))
 		{
-			std::cout << "Error Loading Obj!" << std::endl << "Model at path: '" << path << "' doesn't have inds divisible by 3 to make correct TRIs" << std::endl;
-			return false;
+			closest = t;
+			hitIndex = triIndex;
+			hitT = t;
+			hitU = u;
+			hitV = v;
+			return true;
 		}
-		for (int i = 0; i < shape.mesh.indices.size(); i+=3)
-		{
-			std::array<AA::Vertex, 3> verts;
-			auto index = shape.mesh.indices;
-
-			////Retrieve the vertex information from the loaded attributes
-
-			////Vertex 1 --------------------------------------------------------
-			//Position
-			verts[0]._position[0] = attributes.vertices[3 * index[i].vertex_index + 0];
-			verts[0]._position[1] = attributes.vertices[3 * index[i].vertex_index + 1];
-			verts[0]._position[2] = attributes.vertices[3 * index[i].vertex_index + 2];
-
-			//Normal
-			verts[0]._normal[0] = attributes.normals[3 * index[i].normal_index + 0];
-			verts[0]._normal[1] = attributes.normals[3 * index[i].normal_index + 1];
-			verts[0]._normal[2] = attributes.normals[3 * index[i].normal_index + 2];
-
-			//Tex cords
-			verts[0]._texCord[0] = attributes.texcoords[2 * index[i].texcoord_index + 0];
-			verts[0]._texCord[1] = attributes.texcoords[2 * index[i].texcoord_index + 1];
-
-			////Vertex 2 --------------------------------------------------------
-			//Position
-			verts[1]._position[0] = attributes.vertices[3 * index[i + 1].vertex_index + 0];
-			verts[1]._position[1] = attributes.vertices[3 * index[i + 1].vertex_index + 1];
-			verts[1]._position[2] = attributes.vertices[3 * index[i + 1].vertex_index + 2];
-
-			//Normal
-			verts[1]._normal[0] = attributes.normals[3 * index[i + 1].normal_index + 0];
-			verts[1]._normal[1] = attributes.normals[3 * index[i + 1].normal_index + 1];
-			verts[1]._normal[2] = attributes.normals[3 * index[i + 1].normal_index + 2];
-
-			//Tex cords
-			verts[1]._texCord[0] = attributes.texcoords[2 * index[i + 1].texcoord_index + 0];
-			verts[1]._texCord[1] = attributes.texcoords[2 * index[i + 1].texcoord_index + 1];
-
-			////Vertex 3 --------------------------------------------------------
-			//Position
-			verts[2]._position[0] = attributes.vertices[3 * index[i + 2].vertex_index + 0];
-			verts[2]._position[1] = attributes.vertices[3 * index[i + 2].vertex_index + 1];
-			verts[2]._position[2] = attributes.vertices[3 * index[i + 2].vertex_index + 2];
-
-			//Normal
-			verts[2]._normal[0] = attributes.normals[3 * index[i + 2].normal_index + 0];
-			verts[2]._normal[1] = attributes.normals[3 * index[i + 2].normal_index + 1];
-			verts[2]._normal[2] = attributes.normals[3 * index[i + 2].normal_index + 2];
-
-			//Tex cords
-			verts[2]._texCord[0] = attributes.texcoords[2 * index[i + 2].texcoord_index + 0];
-			verts[2]._texCord[1] = attributes.texcoords[2 * index[i + 2].texcoord_index + 1];
+		return false;
+	};
 
-			for (auto& vert : verts)
+	////With BVH
+	//Whole leaves go through the batched test, any hit has to clear epsilon as well as t_min so that's folded into the range
+	if (_data->GetBvh() != nullptr)
+	{
+		double hitMin = closestOnly ? t_min : std::max(t_min, static_cast<double>(AA::kHitEpsilon));
+		_data->GetBvh()->TraverseLeaves(objectRay, t_min, t_max, [&](const uint32_t* triIndices, uint32_t triCount, double& closest)
+		{
+			if (!store.IntersectNearest(triIndices, triCount, objectRay, hitMin, closest, hitIndex, hitT, hitU, hitV))
 			{
-				switch (param)
-				{
-					case Mesh::ModelParams::FLIP_X:
-						vert._position[0] *= -1;
-						vert._normal[0] *= -1;
-						break;
-					case Mesh::ModelParams::FLIP_Y:
-						vert._position[1] *= -1;
-						vert._normal[1] *= -1;
-						break;
-					case Mesh::ModelParams::FLIP_Z:
-						vert._position[2] *= -1;
-						break;
-				}
+				return false;
 			}
+			closest = hitT;
+			return true;
+		});
+	}
 
-			if (param != ModelParams::DEFAULT)
+	//// Without BVH
+	else
+	{
+		double closestHit = t_max;
+		for (uint32_t i = 0; i < store.Size(); ++i)
+		{
+			if (testTri(i, closestHit) && !closestOnly)
 			{
-				verts = std::array<AA::Vertex, 3>({ verts[2], verts[1], verts[0] });
+				break;
 			}
-			////Create the Tri and push it back onto vector
-			_tris.push_back(new Triangle(verts, _position, _scale, _meshTexture.get(), _isStatic, _material.get(), _sceneLight));
 		}
 	}
 
-	return true;
-}
-
-bool Mesh::LoadTexture(const char* path)
-{
-	sf::Image texture;
-	if (texture.loadFromFile(path))
+	if (hitIndex == UINT32_MAX)
 	{
-		_meshTexture = std::make_unique<sf::Image>(std::move(texture));
-		return true;
+		return false;
 	}
-	return false;
-}
 
-void Mesh::UpdateTrisPosition()
-{
-	for (auto& tri : _tris)
+	if (closestOnly)
 	{
-		tri->Move(_position);
+		static_cast<Triangle*>(_data->GetTris()[hitIndex])->ShadeHit(objectRay, hitT, hitU, hitV, res);
 	}
-}
-
-void Mesh::UpdateTrisScale()
-{
-	for (auto& tri : _tris)
+	else
 	{
-		tri->Scale(_scale);
+		res.t = hitT;
 	}
+	return true;
 }
 
 bool Mesh::BoundingBox(double t0, double t1, AABB& outBox) const
 {
-	if (_tris.size() < 1)
+	if (_data->GetTris().size() < 1)
 	{
 		return false;
 	}
 
-	AABB tempBox;
-	bool didExpand = false;
+	//Scale can be negative to mirror the mesh so both corners are transformed and sorted again
+	AA::Vec3 cornerA = _data->GetBounds().Min() * _scale + _position;
+	AA::Vec3 cornerB = _data->GetBounds().Max() * _scale + _position;
+	outBox = AABB::Empty();
+	outBox.Expand(cornerA);
+	outBox.Expand(cornerB);
+	return true;
+}
 
-	if (!_tris.front()->BoundingBox(t0, t1, tempBox))
-	{
-		return false;
-	}
-	else
+void Mesh::GatherBvhStats(const std::string& name, std::vector<BvhStats>& outStats) const
+{
+	//The tree is in the shared data's object space so every instance of a model reports the same numbers
+	if (_data->GetBvh() != nullptr && _data->GetBvh()->IsConstructed())
 	{
-		//Loop over all objects in the scene and expand the surrounding bounding box
-		outBox = tempBox;
-		for (int i = 1; i < _tris.size(); i++)
-		{
-			if (_tris[i]->BoundingBox(t0, t1, tempBox))
-			{
-				didExpand = true;
-				outBox = AABB::SurroundingBox(outBox, tempBox);
-			}
-		}
+		outStats.push_back(BvhStats::Gather(name + " " + _data->GetName(), *_data->GetBvh(), _data->GetTris()));
 	}
-
-	//If the box never expanded just the box for the first object will do for later calcs, a full scene wide one isnt needed
-	return didExpand;
 }
 
 void Mesh::Move(AA::Vec3 newPos)
 {
 	if(_isStatic) { return; }
 	_position = newPos;
-	UpdateTrisPosition();
+	_isDirty = true;
 }
 
 void Mesh::Scale(AA::Vec3 newScale)
 {
 	if(_isStatic) { return; }
 	_scale = newScale;
-	UpdateTrisScale();
+	_isDirty = true;
 }
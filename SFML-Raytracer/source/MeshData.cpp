@@ -0,0 +1,295 @@
+#include "..\include\MeshData.h"
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+#include "Triangle.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+
+std::unordered_map<std::string, std::weak_ptr<MeshData>> MeshData::_loadedMeshes;
+
+std::shared_ptr<MeshData> MeshData::Get(const char* modelPath, const char* texturePath, ModelParams param, bool useBvh, bool useSah, bool useSpatialSplits, JobManager* jobManager)
+{
+	//Anything that changes the loaded triangles or the tree built over them has to be part of the key
+	std::string key = std::string(modelPath) + "|" + texturePath + "|" + std::to_string(static_cast<int>(param)) + "|" + (useBvh ? (useSah ? (useSpatialSplits ? "SBVH" : "SAH") : "BVH") : "NONE");
+
+	std::shared_ptr<MeshData> data = _loadedMeshes[key].lock();
+	if (!data)
+	{
+		data = std::shared_ptr<MeshData>(new MeshData(modelPath, texturePath, param, useBvh, useSah, useSpatialSplits, jobManager));
+		_loadedMeshes[key] = data;
+	}
+	return data;
+}
+
+MeshData::MeshData(const char* modelPath, const char* texturePath, ModelParams param, bool useBvh, bool useSah, bool useSpatialSplits, JobManager* jobManager)
+	: _name(modelPath)
+{
+	LoadTexture(texturePath);
+	LoadModel(modelPath, param);
+
+	for (const Hittable* tri : _tris)
+	{
+		AABB triBox;
+		tri->BoundingBox(0.0, 0.0, triBox);
+		_bounds.Expand(triBox);
+	}
+
+	if (useBvh)
+	{
+		LinearBvh::BuildType type = useSah ? (useSpatialSplits ? LinearBvh::BuildType::SPATIAL_SAH : LinearBvh::BuildType::BINNED_SAH) : LinearBvh::BuildType::DUMB;
+		LoadOrBuildBvh(modelPath, param, type, jobManager);
+		SortTrisToLeafOrder();
+	}
+
+	//Mesh data never moves, instances move the ray instead, so this only ever needs doing once
+	_store.Build(_tris);
+}
+
+MeshData::~MeshData()
+{
+	for (auto& tri : _tris)
+	{
+		delete tri;
+	}
+}
+
+void MeshData::LoadOrBuildBvh(const char* modelPath, ModelParams param, LinearBvh::BuildType type, JobManager* jobManager)
+{
+	//Mesh data never moves in its own object space, the SAH trees get the treelet pass since the build is paid once and then usually cached
+	_bvh = std::make_unique<LinearBvh>();
+	_bvh->SetTreeletPasses(type == LinearBvh::BuildType::DUMB ? 0 : LinearBvh::kStaticTreeletPasses);
+	uint32_t triCount = static_cast<uint32_t>(_tris.size());
+
+	uint64_t key = 0;
+	if (triCount == 0 || !BvhCacheKey(modelPath, param, type, _bvh->GetMaxLeafPrims(), _bvh->GetTreeletPasses(), _bvh->GetSpatialSplitAlpha(), key))
+	{
+		_bvh->Build(_tris, type, jobManager);
+		return;
+	}
+
+	std::stringstream cachePath;
+	cachePath << kBvhCacheDir << std::hex << std::setw(16) << std::setfill('0') << key << ".bvh";
+	if (_bvh->Load(cachePath.str(), key, triCount))
+	{
+		return;
+	}
+
+	_bvh->Build(_tris, type, jobManager);
+	_bvh->Save(cachePath.str(), key);
+}
+
+void MeshData::SortTrisToLeafOrder()
+{
+	if (_bvh == nullptr || !_bvh->IsConstructed())
+	{
+		return;
+	}
+
+	//Spatial splits can put a triangle in more than one leaf, it goes wherever it's reached first
+	const std::vector<uint32_t>& leafOrder = _bvh->GetWideBvh().GetPrimIndices();
+	std::vector<uint32_t> newIndices(_tris.size(), UINT32_MAX);
+	std::vector<Hittable*> sortedTris;
+	sortedTris.reserve(_tris.size());
+	for (uint32_t prim : leafOrder)
+	{
+		if (newIndices[prim] == UINT32_MAX)
+		{
+			newIndices[prim] = static_cast<uint32_t>(sortedTris.size());
+			sortedTris.push_back(_tris[prim]);
+		}
+	}
+
+
+	//Anything the tree doesn't reach still belongs to the mesh, it has to be kept to be freed
+	for (uint32_t prim = 0; prim < _tris.size(); ++prim)
+	{
+		if (newIndices[prim] == UINT32_MAX)
+		{
+			newIndices[prim] = static_cast<uint32_t>(sortedTris.size());
+			sortedTris.push_back(_tris[prim]);
+		}
+	}
+
+	_tris.swap(sortedTris);
+	_bvh->RemapPrimIndices(newIndices);
+}
+
+bool MeshData::BvhCacheKey(const char* modelPath, ModelParams param, LinearBvh::BuildType type, uint32_t maxLeafPrims, uint32_t treeletPasses, double spatialSplitAlpha, uint64_t& outKey)
+{
+	std::ifstream file(modelPath, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+	std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	//FNV-1a over the file then the settings, the cache version is checked separately when the file is read
+	const uint64_t kFnvPrime = 0x100000001b3;
+	uint64_t hash = 0xcbf29ce484222325;
+	auto hashByte = [&](uint8_t byte)
+	{
+		hash ^= byte;
+		hash *= kFnvPrime;
+	};
+
+	for (char c : bytes)
+	{
+		hashByte(static_cast<uint8_t>(c));
+	}
+	hashByte(static_cast<uint8_t>(param));
+	hashByte(static_cast<uint8_t>(type));
+	hashByte(static_cast<uint8_t>(maxLeafPrims));
+	hashByte(static_cast<uint8_t>(treeletPasses));
+
+	//The threshold only changes spatial split trees so leaving it out of the others keeps their cached files valid when it's tuned
+	if (type == LinearBvh::BuildType::SPATIAL_SAH)
+	{
+		const uint8_t* alphaBytes = reinterpret_cast<const uint8_t*>(&spatialSplitAlpha);
+		for (size_t i = 0; i < sizeof(spatialSplitAlpha); ++i)
+		{
+			hashByte(alphaBytes[i]);
+		}
+	}
+
+	outKey = hash;
+	return true;
+}
+
+bool MeshData::LoadModel(const char* path, ModelParams param)
+{
+	tinyobj::attrib_t attributes;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warn, err;
+
+	if (!tinyobj::LoadObj(&attributes, &shapes, &materials, &warn, &err, path))
+	{
+		std::cout << "Error loading Obj! Info below:" << std::endl << "Warning: " << warn << std::endl << "Error: " << err << std::endl;
+		return false;
+	}
+
+	//Corners shared between triangles only get stored once, the map is only needed while loading
+	std::unordered_map<AA::Vertex, uint32_t> uniqueVerts = {};
+	size_t indexCount = 0;
+	for (const auto& shape : shapes)
+	{
+		indexCount += shape.mesh.indices.size();
+	}
+	_vertexBuffer.indices.reserve(indexCount);
+	uniqueVerts.reserve(indexCount);
+
+	for (const auto& shape : shapes)
+	{
+		if (shape.mesh.indices.size() % 3 != 0)
+		{
+			std::cout << "Error Loading Obj!" << std::endl << "Model at path: '" << path << "' doesn't have inds divisible by 3 to make correct TRIs" << std::endl;
+			return false;
+		}
+		for (int i = 0; i < shape.mesh.indices.size(); i+=3)
+		{
+			std::array<AA::Vertex, 3> verts;
+			const auto& index = shape.mesh.indices;
+
+			////Retrieve the vertex information from the loaded attributes
+
+			////Vertex 1 --------------------------------------------------------
+			//Position
+			verts[0]._position[0] = attributes.vertices[3 * index[i].vertex_index + 0];
+			verts[0]._position[1] = attributes.vertices[3 * index[i].vertex_index + 1];
+			verts[0]._position[2] = attributes.vertices[3 * index[i].vertex_index + 2];
+
+			//Normal
+			verts[0]._normal[0] = attributes.normals[3 * index[i].normal_index + 0];
+			verts[0]._normal[1] = attributes.normals[3 * index[i].normal_index + 1];
+			verts[0]._normal[2] = attributes.normals[3 * index[i].normal_index + 2];
+
+			//Tex cords
+			verts[0]._texCord[0] = attributes.texcoords[2 * index[i].texcoord_index + 0];
+			verts[0]._texCord[1] = attributes.texcoords[2 * index[i].texcoord_index + 1];
+
+			////Vertex 2 --------------------------------------------------------
+			//Position
+			verts[1]._position[0] = attributes.vertices[3 * index[i + 1].vertex_index + 0];
+			verts[1]._position[1] = attributes.vertices[3 * index[i + 1].vertex_index + 1];
+			verts[1]._position[2] = attributes.vertices[3 * index[i + 1].vertex_index + 2];
+
+			//Normal
+			verts[1]._normal[0] = attributes.normals[3 * index[i + 1].normal_index + 0];
+			verts[1]._normal[1] = attributes.normals[3 * index[i + 1].normal_index + 1];
+			verts[1]._normal[2] = attributes.normals[3 * index[i + 1].normal_index + 2];
+
+			//Tex cords
+			verts[1]._texCord[0] = attributes.texcoords[2 * index[i + 1].texcoord_index + 0];
+			verts[1]._texCord[1] = attributes.texcoords[2 * index[i + 1].texcoord_index + 1];
+
+			////Vertex 3 --------------------------------------------------------
+			//Position
+			verts[2]._position[0] = attributes.vertices[3 * index[i + 2].vertex_index + 0];
+			verts[2]._position[1] = attributes.vertices[3 * index[i + 2].vertex_index + 1];
+			verts[2]._position[2] = attributes.vertices[3 * index[i + 2].vertex_index + 2];
+
+			//Normal
+			verts[2]._normal[0] = attributes.normals[3 * index[i + 2].normal_index + 0];
+			verts[2]._normal[1] = attributes.normals[3 * index[i + 2].normal_index + 1];
+			verts[2]._normal[2] = attributes.normals[3 * index[i + 2].normal_index + 2];
+
+			//Tex cords
+			verts[2]._texCord[0] = attributes.texcoords[2 * index[i + 2].texcoord_index + 0];
+			verts[2]._texCord[1] = attributes.texcoords[2 * index[i + 2].texcoord_index + 1];
+
+			for (auto& vert : verts)
+			{
+				switch (param)
+				{
+					case ModelParams::FLIP_X:
+						vert._position[0] *= -1;
+						vert._normal[0] *= -1;
+						break;
+					case ModelParams::FLIP_Y:
+						vert._position[1] *= -1;
+						vert._normal[1] *= -1;
+						break;
+					case ModelParams::FLIP_Z:
+						vert._position[2] *= -1;
+						break;
+				}
+			}
+
+			if (param != ModelParams::DEFAULT)
+			{
+				verts = std::array<AA::Vertex, 3>({ verts[2], verts[1], verts[0] });
+			}
+			uint32_t firstIndex = static_cast<uint32_t>(_vertexBuffer.indices.size());
+			for (const auto& vert : verts)
+			{
+				auto found = uniqueVerts.find(vert);
+				if (found == uniqueVerts.end())
+				{
+					found = uniqueVerts.emplace(vert, static_cast<uint32_t>(_vertexBuffer.vertices.size())).first;
+					_vertexBuffer.vertices.push_back(vert);
+				}
+				_vertexBuffer.indices.push_back(found->second);
+			}
+
+			////Create the Tri and push it back onto vector
+			//Kept in object space with no material or light, the Mesh instances placing this data supply both
+			_tris.push_back(new Triangle(&_vertexBuffer, firstIndex, AA::Vec3(0.0, 0.0, 0.0), AA::Vec3(1.0, 1.0, 1.0), _texture.get(), true, nullptr, nullptr));
+		}
+	}
+
+	return true;
+}
+
+bool MeshData::LoadTexture(const char* path)
+{
+	sf::Image texture;
+	if (texture.loadFromFile(path))
+	{
+		_texture = std::make_unique<sf::Image>(std::move(texture));
+		return true;
+	}
+	return false;
+}
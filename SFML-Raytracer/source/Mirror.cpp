@@ -15,7 +15,7 @@ AA::Vec3 Mirror::MaterialCalculatedColour(const AA::Ray& prevRay, const Hittable
 	Hittable::HitResult staticRes, dynamicRes;
 	bool staticHit, dynamicHit;
 	AA::Ray materialRay = AA::Ray(prevHit.p, prevHit.normal);
-	materialRay._startPos = materialRay.GetPointAlongRay(AA::kEpsilon);
+	materialRay._startPos = materialRay.GetPointAlongRay(AA::kHitEpsilon);
 
 	staticHit = _statics == nullptr ? false : _statics->IntersectedRay(materialRay, 0.0, INFINITY, staticRes);
 	dynamicHit = _dynamics == nullptr ? false : _dynamics->IntersectedRay(materialRay, 0.0, INFINITY, dynamicRes);
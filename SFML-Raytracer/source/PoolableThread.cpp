@@ -1,13 +1,8 @@
 #include "..\include\PoolableThread.h"
-#include <chrono>
 
-PoolableThread::PoolableThread()
+PoolableThread::PoolableThread(std::function<void()> threadLoop)
 {
-	std::promise<void> exitPromise;
-	_exitFuture = exitPromise.get_future();
-
-	_thread = std::thread(&PoolableThread::ThreadLoop, this, std::move(exitPromise));
-	_thread.detach();
+	_thread = std::thread(threadLoop);
 }
 
 PoolableThread::~PoolableThread()
@@ -15,40 +10,10 @@ PoolableThread::~PoolableThread()
 	WaitForThreadToExit();
 }
 
-bool PoolableThread::IsThreadIdle()
-{
-	return _threadIdle;
-}
-
-void PoolableThread::RunTaskOnThread(std::function<void()> task)
-{
-	_task = task;
-	_threadIdle = false;
-}
-
 void PoolableThread::WaitForThreadToExit()
 {
-	_threadAlive = false;
-	_exitFuture.wait();
-}
-
-void PoolableThread::ThreadLoop(std::promise<void> exitPromise)
-{
-	while (_threadAlive)
+	if (_thread.joinable())
 	{
-		
-		if (_task != nullptr)
-		{
-			_task();
-			_testCounter = 0;
-			_task = nullptr;
-			_threadIdle = true;
-		}
-		else
-		{
-			_testCounter++;
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		}
+		_thread.join();
 	}
-	exitPromise.set_value();
 }
@@ -98,6 +98,30 @@ bool Sphere::IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max,
     return false;
 }
 
+bool Sphere::Occluded(const AA::Ray& ray, double t_min, double t_max)
+{
+    AA::Vec3 oc = ray._startPos - _origin;
+    double a = ray._dir.DotProduct(ray._dir);
+    double b = oc.DotProduct(ray._dir);
+    double c = oc.DotProduct(oc) - _radius * _radius;
+
+    double discrim = b * b - a * c;
+    if (discrim <= 0)
+    {
+        return false;
+    }
+
+    //Either root inside the range is enough, nothing about the hit is needed
+    double root = sqrt(discrim);
+    double temp = (-b - root) / a;
+    if (temp < t_max && temp > t_min)
+    {
+        return true;
+    }
+    temp = (-b + root) / a;
+    return temp < t_max && temp > t_min;
+}
+
 bool Sphere::BoundingBox(double t0, double t1, AABB& outBox) const
 {
     outBox = AABB(
@@ -112,10 +136,12 @@ void Sphere::Move(AA::Vec3 newPos)
 {
     if(_isStatic) { return; }
     _origin = newPos;
+    _isDirty = true;
 }
 
 void Sphere::Scale(AA::Vec3 newScale)
 {
     if(_isStatic) { return; }
     _radius = newScale.X();
+    _isDirty = true;
 }
@@ -0,0 +1,125 @@
+#include "..\include\TaskGraph.h"
+#include "JobManager.h"
+#include <iostream>
+
+TaskGraph::TaskId TaskGraph::AddTask(std::function<void()> func, std::initializer_list<TaskId> dependsOn, Affinity affinity)
+{
+	TaskId task = static_cast<TaskId>(_tasks.size());
+	_tasks.push_back({ std::move(func), {}, affinity, 0 });
+
+	for (TaskId before : dependsOn)
+	{
+		AddDependency(before, task);
+	}
+	return task;
+}
+
+void TaskGraph::AddDependency(TaskId before, TaskId after)
+{
+	//Only letting tasks depend on ones added before them means the graph can't end up with a cycle that never runs
+	if (before >= after || after >= _tasks.size())
+	{
+		std::cout << "TaskGraph: task " << after << " can't depend on task " << before << ", dependencies have to be added in order" << std::endl;
+		return;
+	}
+
+	_tasks[before].successors.push_back(after);
+	++_tasks[after].predecessorCount;
+}
+
+void TaskGraph::AddSignalDependency(TaskId task)
+{
+	++_tasks[task].predecessorCount;
+}
+
+void TaskGraph::Signal(TaskId task)
+{
+	if (--_pendingCounts[task] == 0)
+	{
+		Launch(task);
+	}
+}
+
+void TaskGraph::Run(JobManager* jobManager)
+{
+	uint32_t taskCount = GetTaskCount();
+	if (_pendingCountsSize != taskCount)
+	{
+		_pendingCounts = std::unique_ptr<std::atomic<uint32_t>[]>(new std::atomic<uint32_t>[taskCount]);
+		_pendingCountsSize = taskCount;
+	}
+
+	//Every count is reset before anything launches, an early task finishing can't touch a count that hasn't been set yet
+	for (TaskId task = 0; task < taskCount; ++task)
+	{
+		_pendingCounts[task].store(_tasks[task].predecessorCount);
+	}
+
+	_jobManager = jobManager;
+	_readyTasks.clear();
+	_readyTasks.reserve(taskCount);
+	for (TaskId task = 0; task < taskCount; ++task)
+	{
+		if (_tasks[task].predecessorCount == 0)
+		{
+			Launch(task);
+		}
+	}
+
+	if (_jobManager != nullptr)
+	{
+		_jobManager->ProcessJobs();
+	}
+	else
+	{
+		//Tasks only get added to the ready list once everything before them has run, so working through it in order is enough
+		for (size_t i = 0; i < _readyTasks.size(); ++i)
+		{
+			Execute(_readyTasks[i]);
+		}
+	}
+	_jobManager = nullptr;
+}
+
+void TaskGraph::Clear()
+{
+	_tasks.clear();
+	_pendingCounts.reset();
+	_pendingCountsSize = 0;
+}
+
+void TaskGraph::Launch(TaskId task)
+{
+	if (_jobManager == nullptr)
+	{
+		_readyTasks.push_back(task);
+		return;
+	}
+
+	JobManager::Job job([this, task]() { Execute(task); });
+	if (_tasks[task].affinity == Affinity::MAIN_THREAD)
+	{
+		_jobManager->AddMainThreadJob(std::move(job));
+	}
+	else
+	{
+		_jobManager->AddJobToQueue(std::move(job));
+	}
+}
+
+void TaskGraph::Execute(TaskId task)
+{
+	if (_tasks[task].func)
+	{
+		_tasks[task].func();
+	}
+
+	//Whoever finishes a successor's last predecessor is the one that queues it
+	for (TaskId successor : _tasks[task].successors)
+	{
+		if (--_pendingCounts[successor] == 0)
+		{
+			Launch(successor);
+		}
+	}
+}
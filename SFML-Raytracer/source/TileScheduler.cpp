@@ -0,0 +1,149 @@
+#include "..\include\TileScheduler.h"
+#include "JobManager.h"
+#include <algorithm>
+
+TileScheduler::TileScheduler(int tileSize) : _tileSize(std::max(tileSize, 1)), _stealCount(0)
+{
+}
+
+void TileScheduler::Resize(int frameWidth, int frameHeight, int workerCount)
+{
+	_tiles.clear();
+	_tilesPerRow = (frameWidth + _tileSize - 1) / _tileSize;
+	_rowCount = (frameHeight + _tileSize - 1) / _tileSize;
+	for (int y = 0; y < frameHeight; y += _tileSize)
+	{
+		for (int x = 0; x < frameWidth; x += _tileSize)
+		{
+			_tiles.push_back({ x, y, std::min(_tileSize, frameWidth - x), std::min(_tileSize, frameHeight - y) });
+		}
+	}
+	_rowTilesLeft = std::unique_ptr<std::atomic<uint32_t>[]>(new std::atomic<uint32_t>[std::max(_rowCount, 1)]);
+	_rowTilesSkipped = std::unique_ptr<std::atomic<uint32_t>[]>(new std::atomic<uint32_t>[std::max(_rowCount, 1)]);
+	for (int row = 0; row < _rowCount; ++row)
+	{
+		_rowTilesSkipped[row].store(0);
+	}
+
+	_queues.clear();
+	workerCount = std::max(workerCount, 1);
+	for (int i = 0; i < workerCount; ++i)
+	{
+		_queues.emplace_back(std::make_unique<WorkerQueue>());
+	}
+}
+
+void TileScheduler::RenderFrame(JobManager* jobManager, const std::function<void(const Tile&)>& renderTile)
+{
+	QueueFrame(jobManager, renderTile);
+	if (jobManager != nullptr)
+	{
+		jobManager->ProcessJobs();
+	}
+}
+
+void TileScheduler::QueueFrame(JobManager* jobManager, std::function<void(const Tile&)> renderTile, std::function<void(int)> onRowFinished, const CancellationToken* cancel)
+{
+	//Each worker starts on a contiguous band of tiles so neighbouring pixels share what they pull into cache, stealing evens out the expensive bands
+	uint32_t tileCount = GetTileCount();
+	uint32_t workerCount = static_cast<uint32_t>(_queues.size());
+	for (uint32_t worker = 0; worker < workerCount; ++worker)
+	{
+		uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(tileCount) * worker) / workerCount);
+		uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(tileCount) * (worker + 1)) / workerCount);
+
+		std::deque<uint32_t>& tiles = _queues[worker]->tiles;
+		tiles.clear();
+		for (uint32_t tile = start; tile < end; ++tile)
+		{
+			tiles.push_back(tile);
+		}
+	}
+	_stealCount = 0;
+
+	for (int row = 0; row < _rowCount; ++row)
+	{
+		_rowTilesLeft[row].store(_tilesPerRow);
+		_rowTilesSkipped[row].store(0);
+	}
+	_jobManager = jobManager;
+	_renderTile = std::move(renderTile);
+	_onRowFinished = std::move(onRowFinished);
+	_cancel = cancel;
+
+	if (jobManager == nullptr)
+	{
+		for (uint32_t worker = 0; worker < workerCount; ++worker)
+		{
+			WorkerLoop(worker);
+		}
+		return;
+	}
+
+	for (uint32_t worker = 0; worker < workerCount; ++worker)
+	{
+		jobManager->AddJobToQueue(JobManager::Job([this, worker]() { WorkerLoop(worker); }));
+	}
+}
+
+void TileScheduler::WorkerLoop(int worker)
+{
+	//Tiles never get added mid frame, so once there's nothing to pop or steal every remaining tile is already being worked on
+	uint32_t tile;
+	while (PopLocal(worker, tile) || Steal(worker, tile))
+	{
+		int row = static_cast<int>(tile) / _tilesPerRow;
+		if (_cancel == nullptr || !_cancel->IsCancelled())
+		{
+			_renderTile(_tiles[tile]);
+		}
+		else
+		{
+			++_rowTilesSkipped[row];
+		}
+
+		if (--_rowTilesLeft[row] == 0 && _onRowFinished)
+		{
+			_onRowFinished(row);
+		}
+
+		//Whichever worker the main thread picked up would otherwise hold its jobs, like texture uploads, until every tile is gone
+		if (_jobManager != nullptr)
+		{
+			_jobManager->RunMainThreadJobs();
+		}
+	}
+}
+
+bool TileScheduler::PopLocal(int worker, uint32_t& outTile)
+{
+	WorkerQueue& queue = *_queues[worker];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tiles.empty())
+	{
+		return false;
+	}
+
+	outTile = queue.tiles.front();
+	queue.tiles.pop_front();
+	return true;
+}
+
+bool TileScheduler::Steal(int worker, uint32_t& outTile)
+{
+	//Walks round from the next worker along so thieves spread across victims rather than all hitting the first
+	int workerCount = static_cast<int>(_queues.size());
+	for (int offset = 1; offset < workerCount; ++offset)
+	{
+		WorkerQueue& victim = *_queues[(worker + offset) % workerCount];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tiles.empty())
+		{
+			outTile = victim.tiles.back();
+			victim.tiles.pop_back();
+			++_stealCount;
+			return true;
+		}
+	}
+	return false;
+}
@@ -2,33 +2,9 @@
 #include "Light.h"
 #include "Material.h"
 
-Triangle::Triangle(std::array<AA::Vertex, 3> verts, AA::Vec3 position, AA::Vec3 scale, sf::Image* texPtr, bool isStatic, Material* mat, Light* sceneLight)
-	: Hittable(isStatic, nullptr, sceneLight), _verts(verts), _pos(position), _scale(scale), _texturePtr(texPtr), _materialRaw(mat)
+Triangle::Triangle(const IndexedVertices* buffer, uint32_t firstIndex, AA::Vec3 position, AA::Vec3 scale, sf::Image* texPtr, bool isStatic, Material* mat, Light* sceneLight)
+	: Hittable(isStatic, nullptr, sceneLight), _buffer(buffer), _firstIndex(firstIndex), _pos(position), _scale(scale), _texturePtr(texPtr), _materialRaw(mat)
 {
-	//Set up the bounds for the Tri
-	_bounds[0] = _verts[0]._position;
-	_bounds[1] = _verts[0]._position;
-
-	for (int i = 1; i < _verts.size(); ++i)
-	{
-		//Min
-		_bounds[0][0] = _verts[i]._position.X() < _bounds[0][0] ? _verts[i]._position.X() : _bounds[0][0];
-		_bounds[0][1] = _verts[i]._position.Y() < _bounds[0][1] ? _verts[i]._position.Y() : _bounds[0][1];
-		_bounds[0][2] = _verts[i]._position.Y() < _bounds[0][2] ? _verts[i]._position.Z() : _bounds[0][2];
-
-		//Max
-		_bounds[1][0] = _verts[i]._position.X() > _bounds[1][0] ? _verts[i]._position.X() : _bounds[1][0];
-		_bounds[1][1] = _verts[i]._position.Y() > _bounds[1][1] ? _verts[i]._position.Y() : _bounds[1][1];
-		_bounds[1][2] = _verts[i]._position.Z() > _bounds[1][2] ? _verts[i]._position.Z() : _bounds[1][2];
-	}
-
-	for (int i = 0; i < 2; i++)
-	{
-		for (int j = 0; j < 3; j++)
-		{
-			_bounds[i][j] = i == 0 ? _bounds[i][j] - 1.25 : _bounds[i][j] + 1.25;
-		}
-	}
 }
 
 Triangle::~Triangle()
@@ -37,93 +13,69 @@ Triangle::~Triangle()
 
 bool Triangle::IntersectedRay(const AA::Ray& ray, double t_min, double t_max, HitResult& res)
 {
-	//https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle
-
-	//Check against each tri using Muller Trumbore?
-	// RESEARCH IT FOR THE REPORT HERE https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
-	//Get the verts of the triangle
-	AA::Vertex v0 = _verts[0];
-	AA::Vertex v1 = _verts[1];
-	AA::Vertex v2 = _verts[2];
-
-	//Barycentric co ords
-	double u, v;
-
-	////Apply position and scale
-	v0._position *= _scale;
-	v1._position *= _scale;
-	v2._position *= _scale;
-
-	v0._position += _pos;
-	v1._position += _pos;
-	v2._position += _pos;
-
-	//Calc planes normal
-	AA::Vec3 v0v1 = v1._position - v0._position;
-	AA::Vec3 v0v2 = v2._position - v0._position;
-	AA::Vec3 pvec = ray._dir.CrossProduct(v0v2);
-	float det = v0v1.DotProduct(pvec);
-
-	//Check if the ray misses or if it hits a backfacing tri by checking if determinant is close or below zero
-	if (det < AA::kEpsilon)
+	double t, u, v;
+	if (!IntersectTri(ray, t_min, t_max, t, u, v))
 	{
 		return false;
 	}
 
-	float invDet = 1 / det;
-
-	AA::Vec3 tvec = ray._startPos - v0._position;
-	u = tvec.DotProduct(pvec) * invDet;
-	if (u < 0 || u > 1)
-	{
-		return false;
-	}
-
-	AA::Vec3 qvec = tvec.CrossProduct(v0v1);
-	v = ray._dir.DotProduct(qvec) * invDet;
-	if (v < 0 || u + v > 1)
+	ShadeHit(ray, t, u, v, res);
+	if (_sceneLight != nullptr)
 	{
-		return false;
+		_sceneLight->CalculateLighting(ray, res);
 	}
+	return true;
+}
 
-	//At this point its passed all tests and hit the TRI
-	res.t = v0v2.DotProduct(qvec) * invDet;
+void Triangle::ShadeHit(const AA::Ray& ray, double t, double u, double v, HitResult& res)
+{
+	//Plane normal from the placed verts, left unnormalised like before
+	std::array<AA::Vec3, 3> corners = PlacedCorners();
+	res.t = t;
 	res.p = ray.GetPointAlongRay(res.t);
-	res.normal = v0v1.CrossProduct(v0v2);
+	res.normal = (corners[1] - corners[0]).CrossProduct(corners[2] - corners[0]);
 	res.col = GetPixelColour(u, v);
 	res.mat = _materialRaw;
+}
 
-	if (_sceneLight != nullptr)
+std::array<AA::Vec3, 3> Triangle::PlacedCorners() const
+{
+	return { Vert(0)._position * _scale + _pos, Vert(1)._position * _scale + _pos, Vert(2)._position * _scale + _pos };
+}
+
+bool Triangle::IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max, HitResult& res)
+{
+	double t, u, v;
+	if (!IntersectTri(ray, t_min, t_max, t, u, v) || t <= AA::kHitEpsilon)
 	{
-		_sceneLight->CalculateLighting(ray, res);
+		return false;
 	}
+
+	res.t = t;
+	res.mat = _materialRaw;
 	return true;
 }
 
-bool Triangle::IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max, HitResult& res)
+bool Triangle::Occluded(const AA::Ray& ray, double t_min, double t_max)
 {
-	//Check against each tri using Muller Trumbore?
-	// RESEARCH IT FOR THE REPORT HERE https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
-	//Get the verts of the triangle
-	AA::Vertex v0 = _verts[0];
-	AA::Vertex v1 = _verts[1];
-	AA::Vertex v2 = _verts[2];
-
-	//Barycentric co ords
-	double u, v;
+	double t, u, v;
+	return IntersectTri(ray, t_min, t_max, t, u, v) && t > AA::kHitEpsilon;
+}
 
-	////Apply position and scale
-	v0._position *= _scale;
-	v1._position *= _scale;
-	v2._position *= _scale;
+bool Triangle::IntersectTri(const AA::Ray& ray, double t_min, double t_max, double& outT, double& outU, double& outV) const
+{
+	//https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle
 
-	v0._position += _pos;
-	v1._position += _pos;
-	v2._position += _pos;
+	//Check against each tri using Muller Trumbore?
+	// RESEARCH IT FOR THE REPORT HERE https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
+	//Get the verts of the triangle with position and scale applied
+	AA::Vec3 v0 = Vert(0)._position * _scale + _pos;
+	AA::Vec3 v1 = Vert(1)._position * _scale + _pos;
+	AA::Vec3 v2 = Vert(2)._position * _scale + _pos;
 
 	//Calc planes normal
-	AA::Vec3 v0v1 = v1._position - v0._position;
-	AA::Vec3 v0v2 = v2._position - v0._position;
+	AA::Vec3 v0v1 = v1 - v0;
+	AA::Vec3 v0v2 = v2 - v0;
 	AA::Vec3 pvec = ray._dir.CrossProduct(v0v2);
 	float det = v0v1.DotProduct(pvec);
 
@@ -135,55 +87,112 @@ bool Triangle::IntersectedRayOnly(const AA::Ray& ray, double t_min, double t_max
 
 	float invDet = 1 / det;
 
-	AA::Vec3 tvec = ray._startPos - v0._position;
-	u = tvec.DotProduct(pvec) * invDet;
-	if (u < 0 || u > 1)
+	//Barycentric co ords
+	AA::Vec3 tvec = ray._startPos - v0;
+	outU = tvec.DotProduct(pvec) * invDet;
+	if (outU < 0 || outU > 1)
 	{
 		return false;
 	}
 
 	AA::Vec3 qvec = tvec.CrossProduct(v0v1);
-	v = ray._dir.DotProduct(qvec) * invDet;
-	if (v < 0 || u + v > 1)
+	outV = ray._dir.DotProduct(qvec) * invDet;
+	if (outV < 0 || outU + outV > 1)
 	{
 		return false;
 	}
 
-	//At this point its passed all tests and hit the TRI
-	res.t = v0v2.DotProduct(qvec) * invDet;
-	res.mat = _materialRaw;
-	return res.t > AA::kEpsilon;
+	//At this point its hit the TRI's plane inside the edges, only count it if its within the range being searched
+	outT = v0v2.DotProduct(qvec) * invDet;
+	return outT > t_min && outT < t_max;
 }
 
 bool Triangle::BoundingBox(double t0, double t1, AABB& outBox) const
 {
+	//Worked out when asked rather than stored since the builders are the only ones asking, padded out before the scale like it always has been
+	AA::Vec3 min = Vert(0)._position;
+	AA::Vec3 max = Vert(0)._position;
+	for (int i = 1; i < 3; ++i)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			min[axis] = std::min(min[axis], Vert(i)._position[axis]);
+			max[axis] = std::max(max[axis], Vert(i)._position[axis]);
+		}
+	}
+
+	const AA::Vec3 padding(1.25, 1.25, 1.25);
 	outBox = AABB(
-		(_bounds[0] * _scale) + _pos,
-		(_bounds[1] * _scale) + _pos
+		((min - padding) * _scale) + _pos,
+		((max + padding) * _scale) + _pos
 	);
 
 	return true;
 }
 
+bool Triangle::TightBoundingBox(AABB& outBox) const
+{
+	outBox = AABB::Empty();
+	for (const AA::Vec3& corner : PlacedCorners())
+	{
+		outBox.Expand(corner);
+	}
+	return true;
+}
+
+bool Triangle::ClippedBoundingBox(int axis, double slabMin, double slabMax, AABB& outBox) const
+{
+	//The tri clipped to the slab is bound by its corners inside the slab plus wherever its edges cross either side of it
+	outBox = AABB::Empty();
+	for (int i = 0; i < 3; ++i)
+	{
+		AA::Vec3 a = Vert(i)._position * _scale + _pos;
+		AA::Vec3 b = Vert((i + 1) % 3)._position * _scale + _pos;
+
+		if (a[axis] >= slabMin && a[axis] <= slabMax)
+		{
+			outBox.Expand(a);
+		}
+
+		for (double plane : { slabMin, slabMax })
+		{
+			if ((a[axis] < plane && b[axis] > plane) || (a[axis] > plane && b[axis] < plane))
+			{
+				AA::Vec3 crossing = a + (b - a) * ((plane - a[axis]) / (b[axis] - a[axis]));
+				crossing[axis] = plane;
+				outBox.Expand(crossing);
+			}
+		}
+	}
+	return !outBox.IsEmpty();
+}
+
 void Triangle::Move(AA::Vec3 newPos)
 {
     if(_isStatic) { return; }
     _pos = newPos;
+    _isDirty = true;
 }
 
 void Triangle::Scale(AA::Vec3 newScale)
 {
     if(_isStatic) { return; }
     _scale = newScale;
+    _isDirty = true;
 }
 
 sf::Color Triangle::GetPixelColour(double u, double v)
 {
+	//Triangles shared through MeshData have no material, they hand back the raw colour and the Mesh applies its own material
 	if(_texturePtr == nullptr) 
 	{
+		if (_materialRaw == nullptr)
+		{
+			return AA::NormalToColour(Vert(0)._normal);
+		}
 		if (!_materialRaw->MaterialActive())
 		{
-			_materialRaw->SetColour(AA::NormalToColour(_verts[0]._normal));
+			_materialRaw->SetColour(AA::NormalToColour(Vert(0)._normal));
 		}
 		return _materialRaw->GetColour();
 	}
@@ -192,11 +201,15 @@ sf::Color Triangle::GetPixelColour(double u, double v)
 	double w = 1 - u - v;
 
 	//Times the uvw by the tex cords of each point to get the UV of the point blended between them
-	AA::Vec2 texCoord = AA::Vec2((_verts[1]._texCord * u) + (_verts[2]._texCord * v) + (_verts[0]._texCord * w));
+	AA::Vec2 texCoord = AA::Vec2((Vert(1)._texCord * u) + (Vert(2)._texCord * v) + (Vert(0)._texCord * w));
 
 	//Translate this normalised value to a pixel value from the texture
 	int x = (_texturePtr->getSize().x) * texCoord.X();
 	int y = (_texturePtr->getSize().y) * ( 1.0f - texCoord.Y());
+	if (_materialRaw == nullptr)
+	{
+		return _texturePtr->getPixel(x, y);
+	}
 	_materialRaw->SetColour(_texturePtr->getPixel(x, y));
 	return _materialRaw->GetColour();
 }
@@ -0,0 +1,163 @@
+#include "..\include\TriangleStore.h"
+#include "Triangle.h"
+#include <intrin.h>
+#include <immintrin.h>
+
+void TriangleStore::Build(const std::vector<Hittable*>& tris)
+{
+	Clear();
+#ifdef AA_SINGLE_PRECISION
+	//The AVX kernel works in doubles so it wouldn't match the float scalar test exactly
+	_useAvx = false;
+#else
+	_useAvx = CpuSupportsAvx();
+#endif
+
+	std::vector<AA::Real>* arrays[] = { &_v0X, &_v0Y, &_v0Z, &_edge1X, &_edge1Y, &_edge1Z, &_edge2X, &_edge2Y, &_edge2Z };
+	for (std::vector<AA::Real>* values : arrays)
+	{
+		values->reserve(tris.size());
+	}
+
+	for (const Hittable* hittable : tris)
+	{
+		std::array<AA::Vec3, 3> corners = static_cast<const Triangle*>(hittable)->PlacedCorners();
+		AA::Vec3 edge1 = corners[1] - corners[0];
+		AA::Vec3 edge2 = corners[2] - corners[0];
+
+		_v0X.push_back(corners[0].X());
+		_v0Y.push_back(corners[0].Y());
+		_v0Z.push_back(corners[0].Z());
+		_edge1X.push_back(edge1.X());
+		_edge1Y.push_back(edge1.Y());
+		_edge1Z.push_back(edge1.Z());
+		_edge2X.push_back(edge2.X());
+		_edge2Y.push_back(edge2.Y());
+		_edge2Z.push_back(edge2.Z());
+	}
+}
+
+void TriangleStore::Clear()
+{
+	std::vector<AA::Real>* arrays[] = { &_v0X, &_v0Y, &_v0Z, &_edge1X, &_edge1Y, &_edge1Z, &_edge2X, &_edge2Y, &_edge2Z };
+	for (std::vector<AA::Real>* values : arrays)
+	{
+		values->clear();
+	}
+}
+
+bool TriangleStore::IntersectNearest(const uint32_t* indices, uint32_t count, const AA::Ray& ray, double t_min, double t_max, uint32_t& outIndex, double& outT, double& outU, double& outV) const
+{
+	return _useAvx ? IntersectNearestAvx(indices, count, ray, t_min, t_max, outIndex, outT, outU, outV) : IntersectNearestScalar(indices, count, ray, t_min, t_max, outIndex, outT, outU, outV);
+}
+
+bool TriangleStore::IntersectNearestScalar(const uint32_t* indices, uint32_t count, const AA::Ray& ray, double t_min, double t_max, uint32_t& outIndex, double& outT, double& outU, double& outV) const
+{
+	bool didHit = false;
+	double t, u, v;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (Intersect(indices[i], ray, t_min, t_max, t, u, v))
+		{
+			t_max = t;
+			outIndex = indices[i];
+			outT = t;
+			outU = u;
+			outV = v;
+			didHit = true;
+		}
+	}
+	return didHit;
+}
+
+bool TriangleStore::IntersectNearestAvx(const uint32_t* indices, uint32_t count, const AA::Ray& ray, double t_min, double t_max, uint32_t& outIndex, double& outT, double& outU, double& outV) const
+{
+	const __m256d dirX = _mm256_set1_pd(ray._dir.X());
+	const __m256d dirY = _mm256_set1_pd(ray._dir.Y());
+	const __m256d dirZ = _mm256_set1_pd(ray._dir.Z());
+	const __m256d startX = _mm256_set1_pd(ray._startPos.X());
+	const __m256d startY = _mm256_set1_pd(ray._startPos.Y());
+	const __m256d startZ = _mm256_set1_pd(ray._startPos.Z());
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d rayMin = _mm256_set1_pd(t_min);
+	const __m256d epsilon = _mm256_set1_pd(AA::kEpsilon);
+	const __m128 floatOne = _mm_set1_ps(1.0f);
+
+	bool didHit = false;
+	for (uint32_t base = 0; base < count; base += 4)
+	{
+		//A short last batch repeats its first triangle in the spare lanes, they're masked off below
+		uint32_t lanes = std::min(count - base, 4u);
+		uint32_t lane[4];
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			lane[i] = indices[base + (i < lanes ? i : 0)];
+		}
+		auto gather = [&lane](const std::vector<AA::Real>& values) { return _mm256_set_pd(values[lane[3]], values[lane[2]], values[lane[1]], values[lane[0]]); };
+
+		__m256d edge1X = gather(_edge1X), edge1Y = gather(_edge1Y), edge1Z = gather(_edge1Z);
+		__m256d edge2X = gather(_edge2X), edge2Y = gather(_edge2Y), edge2Z = gather(_edge2Z);
+
+		//Every step is the same sum in the same order as Intersect so each lane rounds exactly like the scalar test
+		__m256d pX = _mm256_sub_pd(_mm256_mul_pd(dirY, edge2Z), _mm256_mul_pd(dirZ, edge2Y));
+		__m256d pY = _mm256_sub_pd(_mm256_mul_pd(dirZ, edge2X), _mm256_mul_pd(dirX, edge2Z));
+		__m256d pZ = _mm256_sub_pd(_mm256_mul_pd(dirX, edge2Y), _mm256_mul_pd(dirY, edge2X));
+		__m256d det = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(edge1X, pX), _mm256_mul_pd(edge1Y, pY)), _mm256_mul_pd(edge1Z, pZ));
+
+		//The scalar test keeps the determinant and its inverse as floats
+		__m128 detFloat = _mm256_cvtpd_ps(det);
+		__m256d keep = _mm256_cmp_pd(_mm256_cvtps_pd(detFloat), epsilon, _CMP_NLT_UQ);
+		__m256d invDet = _mm256_cvtps_pd(_mm_div_ps(floatOne, detFloat));
+
+		__m256d tX = _mm256_sub_pd(startX, gather(_v0X));
+		__m256d tY = _mm256_sub_pd(startY, gather(_v0Y));
+		__m256d tZ = _mm256_sub_pd(startZ, gather(_v0Z));
+		__m256d u = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(tX, pX), _mm256_mul_pd(tY, pY)), _mm256_mul_pd(tZ, pZ)), invDet);
+		keep = _mm256_andnot_pd(_mm256_or_pd(_mm256_cmp_pd(u, zero, _CMP_LT_OQ), _mm256_cmp_pd(u, one, _CMP_GT_OQ)), keep);
+
+		__m256d qX = _mm256_sub_pd(_mm256_mul_pd(tY, edge1Z), _mm256_mul_pd(tZ, edge1Y));
+		__m256d qY = _mm256_sub_pd(_mm256_mul_pd(tZ, edge1X), _mm256_mul_pd(tX, edge1Z));
+		__m256d qZ = _mm256_sub_pd(_mm256_mul_pd(tX, edge1Y), _mm256_mul_pd(tY, edge1X));
+		__m256d v = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dirX, qX), _mm256_mul_pd(dirY, qY)), _mm256_mul_pd(dirZ, qZ)), invDet);
+		keep = _mm256_andnot_pd(_mm256_or_pd(_mm256_cmp_pd(v, zero, _CMP_LT_OQ), _mm256_cmp_pd(_mm256_add_pd(u, v), one, _CMP_GT_OQ)), keep);
+
+		__m256d t = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(edge2X, qX), _mm256_mul_pd(edge2Y, qY)), _mm256_mul_pd(edge2Z, qZ)), invDet);
+		keep = _mm256_and_pd(keep, _mm256_cmp_pd(t, rayMin, _CMP_GT_OQ));
+
+		int hitMask = _mm256_movemask_pd(keep) & ((1 << lanes) - 1);
+		if (hitMask == 0)
+		{
+			continue;
+		}
+
+		//Lanes are taken in order against the shrinking range so ties go to the same triangle the scalar loop would pick
+		alignas(32) double ts[4], us[4], vs[4];
+		_mm256_store_pd(ts, t);
+		_mm256_store_pd(us, u);
+		_mm256_store_pd(vs, v);
+		for (uint32_t i = 0; i < lanes; ++i)
+		{
+			if ((hitMask & (1 << i)) && ts[i] < t_max)
+			{
+				t_max = ts[i];
+				outIndex = lane[i];
+				outT = ts[i];
+				outU = us[i];
+				outV = vs[i];
+				didHit = true;
+			}
+		}
+	}
+	return didHit;
+}
+
+bool TriangleStore::CpuSupportsAvx()
+{
+	//AVX needs the CPU to have it and the OS to save the wider registers on a context switch
+	int info[4];
+	__cpuid(info, 1);
+	bool hasAvx = (info[2] & (1 << 28)) != 0;
+	bool osUsesXsave = (info[2] & (1 << 27)) != 0;
+	return hasAvx && osUsesXsave && (_xgetbv(0) & 0x6) == 0x6;
+}
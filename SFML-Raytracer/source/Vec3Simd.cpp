@@ -0,0 +1,107 @@
+#include "..\include\Vec3Simd.h"
+#include "Utilities.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+
+namespace
+{
+	typedef AA::Vec3Scalar<AA::Real> ScalarVec3;
+	typedef AA::Vec3Simd<AA::Real> SimdVec3;
+
+	//Error FastUnitVector is allowed against the scalar UnitVector, the float rsqrt path is the loosest
+	const double kFastUnitTolerance = 1e-6;
+
+	bool ValuesMatch(AA::Real scalar, AA::Real simd, double tolerance)
+	{
+		if (tolerance == 0.0)
+		{
+			return std::memcmp(&scalar, &simd, sizeof(AA::Real)) == 0;
+		}
+		double scale = std::max(std::abs(static_cast<double>(scalar)), 1.0);
+		return std::abs(static_cast<double>(scalar) - static_cast<double>(simd)) <= tolerance * scale;
+	}
+
+	bool VectorsMatch(const ScalarVec3& scalar, const SimdVec3& simd, double tolerance)
+	{
+		return ValuesMatch(scalar.X(), simd.X(), tolerance) && ValuesMatch(scalar.Y(), simd.Y(), tolerance) && ValuesMatch(scalar.Z(), simd.Z(), tolerance);
+	}
+}
+
+bool AA::CompareVec3Backends(uint32_t samples, double tolerance)
+{
+	std::mt19937 generator(1234);
+	std::uniform_real_distribution<AA::Real> component(-10.0, 10.0);
+	std::uniform_real_distribution<AA::Real> magnitude(0.1, 10.0);
+
+	//Failures per operation, kept in name order so the report reads the same every run
+	std::map<std::string, uint32_t> failures;
+	auto check = [&failures](const char* name, bool matched)
+	{
+		uint32_t& count = failures[name];
+		count += matched ? 0 : 1;
+	};
+
+	for (uint32_t i = 0; i < samples; ++i)
+	{
+		AA::Real ax = component(generator), ay = component(generator), az = component(generator);
+		AA::Real bx = component(generator), by = component(generator), bz = component(generator);
+		AA::Real s = magnitude(generator) * (i % 2 == 0 ? 1 : -1);
+
+		ScalarVec3 sa(ax, ay, az), sb(bx, by, bz);
+		SimdVec3 va(ax, ay, az), vb(bx, by, bz);
+
+		check("a + b", VectorsMatch(sa + sb, va + vb, tolerance));
+		check("a - b", VectorsMatch(sa - sb, va - vb, tolerance));
+		check("a * b", VectorsMatch(sa * sb, va * vb, tolerance));
+		check("a / b", VectorsMatch(sa / sb, va / vb, tolerance));
+		check("a * s", VectorsMatch(sa * s, va * s, tolerance));
+		check("a / s", VectorsMatch(sa / s, va / s, tolerance));
+		check("s * a", VectorsMatch(s * sa, s * va, tolerance));
+		check("s / a", VectorsMatch(s / sa, s / va, tolerance));
+		check("s - a", VectorsMatch(s - sa, s - va, tolerance));
+		check("s + a", VectorsMatch(s + sa, s + va, tolerance));
+
+		ScalarVec3 sSum = sa;
+		SimdVec3 vSum = va;
+		sSum += s;
+		vSum += s;
+		check("a += s", VectorsMatch(sSum, vSum, tolerance));
+
+		check("DotProduct", ValuesMatch(sa.DotProduct(sb), va.DotProduct(vb), tolerance));
+		check("CrossProduct", VectorsMatch(sa.CrossProduct(sb), va.CrossProduct(vb), tolerance));
+		check("Length", ValuesMatch(sa.Length(), va.Length(), tolerance));
+		check("SqrLength", ValuesMatch(sa.SqrLength(), va.SqrLength(), tolerance));
+		check("Distance", ValuesMatch(sa.Distance(sb), va.Distance(vb), tolerance));
+		check("UnitVector", VectorsMatch(sa.UnitVector(), va.UnitVector(), tolerance));
+		check("FastUnitVector", VectorsMatch(sa.UnitVector(), va.FastUnitVector(), std::max(tolerance, kFastUnitTolerance)));
+		check("Min", VectorsMatch(ScalarVec3::Min(sa, sb), SimdVec3::Min(va, vb), tolerance));
+		check("Max", VectorsMatch(ScalarVec3::Max(sa, sb), SimdVec3::Max(va, vb), tolerance));
+
+		sa.MakeUnitVector();
+		va.MakeUnitVector();
+		check("MakeUnitVector", VectorsMatch(sa, va, tolerance));
+
+		check("a == b", (sa == sb) == (va == vb) && (sa == sa) == (va == va));
+		check("a != b", (sa != sb) == (va != vb) && (sa != sa) == (va != va));
+	}
+
+	bool allMatched = true;
+	for (const auto& failure : failures)
+	{
+		if (failure.second > 0)
+		{
+			std::cout << "Vec3 SIMD differs from scalar in " << failure.first << " for " << failure.second << " of " << samples << " samples" << std::endl;
+			allMatched = false;
+		}
+	}
+
+	if (allMatched)
+	{
+		std::cout << "Vec3 SIMD matches scalar over " << samples << " samples" << (tolerance == 0.0 ? " bit for bit" : "") << std::endl;
+	}
+	return allMatched;
+}
@@ -0,0 +1,236 @@
+#include "..\include\WideBvh.h"
+#include "..\include\LinearBvh.h"
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+static_assert(LinearBvh::kMaxLeafPrimsLimit <= UINT8_MAX, "Quantised nodes store leaf sizes in 8 bits, raising the leaf limit past that needs a wider field");
+
+//Scalar copy of DecodeSteps for one step, the builder checks its boxes with the exact same sums the traversal does
+static float DecodeStep(float origin, int step, float scale)
+{
+	return origin + static_cast<float>(step) * scale;
+}
+
+void WideBvh::Build(const LinearBvh& bvh, bool quantised)
+{
+	Clear();
+	if (!bvh.IsConstructed()) { return; }
+
+	_nodes.reserve(bvh.GetNodes().size() / 2 + 1);
+	_primIndices.reserve(bvh.GetPrimIndices().size());
+
+	//A tree that is only a leaf still gets a node so the traversal always starts on an interior one
+	if (bvh.GetNodes()[0].primCount > 0)
+	{
+		_nodes.emplace_back();
+		for (int slot = 0; slot < kWidth; ++slot)
+		{
+			SetChild(0, slot, bvh, slot == 0 ? 0 : UINT32_MAX);
+		}
+	}
+	else
+	{
+		CollapseNode(bvh, 0);
+	}
+
+	if (quantised && !Quantise())
+	{
+		std::cout << "BVH bounds or leaves are too large to quantise, keeping float nodes" << std::endl;
+	}
+}
+
+void WideBvh::Clear()
+{
+	_nodes.clear();
+	_quantisedNodes.clear();
+	_primIndices.clear();
+}
+
+bool WideBvh::Quantise()
+{
+	std::vector<QuantisedNode> quantisedNodes(_nodes.size());
+	for (size_t i = 0; i < _nodes.size(); ++i)
+	{
+		if (!QuantiseNode(_nodes[i], quantisedNodes[i]))
+		{
+			return false;
+		}
+	}
+
+	//Swapped rather than cleared so the float nodes' memory is actually handed back
+	_quantisedNodes.swap(quantisedNodes);
+	std::vector<Node>().swap(_nodes);
+	return true;
+}
+
+bool WideBvh::QuantiseNode(const Node& node, QuantisedNode& outNode)
+{
+	outNode = QuantisedNode();
+	const float* mins[3] = { node.minX, node.minY, node.minZ };
+	const float* maxs[3] = { node.maxX, node.maxY, node.maxZ };
+	uint8_t* stepMins[3] = { outNode.minX, outNode.minY, outNode.minZ };
+	uint8_t* stepMaxs[3] = { outNode.maxX, outNode.maxY, outNode.maxZ };
+
+	//Empty slots are the ones the float node parked at infinity
+	for (int slot = 0; slot < kWidth; ++slot)
+	{
+		//Leaf sizes only get 8 bits, anything bigger would lose primitives so the tree stays on float nodes instead
+		if (node.primCount[slot] > UINT8_MAX)
+		{
+			return false;
+		}
+
+		outNode.child[slot] = node.child[slot];
+		outNode.primCount[slot] = static_cast<uint8_t>(node.primCount[slot]);
+		if (node.minX[slot] != INFINITY)
+		{
+			outNode.slotMask |= static_cast<uint8_t>(1 << slot);
+		}
+	}
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float lo = INFINITY;
+		float hi = -INFINITY;
+		for (int slot = 0; slot < kWidth; ++slot)
+		{
+			if (outNode.slotMask & (1 << slot))
+			{
+				lo = std::min(lo, mins[axis][slot]);
+				hi = std::max(hi, maxs[axis][slot]);
+			}
+		}
+		if (!std::isfinite(lo) || !std::isfinite(hi))
+		{
+			return false;
+		}
+
+		//Smallest step that still reaches the far side from the origin in 255 steps once the sum is rounded
+		double extent = static_cast<double>(hi) - lo;
+		int exponent = extent > 0.0 ? static_cast<int>(std::ceil(std::log2(extent / 255.0))) : -126;
+		exponent = std::max(exponent, -126);
+		while (exponent <= 127 && DecodeStep(lo, 255, StepScale(static_cast<int8_t>(exponent))) < hi)
+		{
+			++exponent;
+		}
+		if (exponent > 127)
+		{
+			return false;
+		}
+
+		float scale = StepScale(static_cast<int8_t>(exponent));
+		outNode.origin[axis] = lo;
+		outNode.exponent[axis] = static_cast<int8_t>(exponent);
+
+		//Start from the nearest step then walk outwards until the decoded box covers the float one
+		for (int slot = 0; slot < kWidth; ++slot)
+		{
+			if ((outNode.slotMask & (1 << slot)) == 0) { continue; }
+
+			int stepMin = static_cast<int>(std::max(0.0, std::min(255.0, std::floor((static_cast<double>(mins[axis][slot]) - lo) / scale))));
+			while (stepMin > 0 && DecodeStep(lo, stepMin, scale) > mins[axis][slot])
+			{
+				--stepMin;
+			}
+
+			int stepMax = static_cast<int>(std::max(0.0, std::min(255.0, std::ceil((static_cast<double>(maxs[axis][slot]) - lo) / scale))));
+			while (stepMax < 255 && DecodeStep(lo, stepMax, scale) < maxs[axis][slot])
+			{
+				++stepMax;
+			}
+
+			stepMins[axis][slot] = static_cast<uint8_t>(stepMin);
+			stepMaxs[axis][slot] = static_cast<uint8_t>(stepMax);
+		}
+	}
+	return true;
+}
+
+uint32_t WideBvh::CollapseNode(const LinearBvh& bvh, uint32_t binaryIndex)
+{
+	const std::vector<LinearBvh::Node>& binary = bvh.GetNodes();
+
+	//Start from the two children and keep opening the largest interior one, the biggest boxes are the ones most worth testing together
+	uint32_t slots[kWidth];
+	int slotCount = 0;
+	slots[slotCount++] = binaryIndex + 1;
+	slots[slotCount++] = binary[binaryIndex].offset;
+
+	while (slotCount < kWidth)
+	{
+		int largest = -1;
+		double largestArea = -1.0;
+		for (int i = 0; i < slotCount; ++i)
+		{
+			const LinearBvh::Node& candidate = binary[slots[i]];
+			if (candidate.primCount == 0 && candidate.box.SurfaceArea() > largestArea)
+			{
+				largest = i;
+				largestArea = candidate.box.SurfaceArea();
+			}
+		}
+
+		if (largest < 0) { break; }
+
+		uint32_t opened = slots[largest];
+		slots[largest] = opened + 1;
+		slots[slotCount++] = binary[opened].offset;
+	}
+
+	uint32_t index = static_cast<uint32_t>(_nodes.size());
+	_nodes.emplace_back();
+
+	for (int slot = 0; slot < kWidth; ++slot)
+	{
+		SetChild(index, slot, bvh, slot < slotCount ? slots[slot] : UINT32_MAX);
+	}
+
+	return index;
+}
+
+void WideBvh::SetChild(uint32_t nodeIndex, int slot, const LinearBvh& bvh, uint32_t binaryIndex)
+{
+	//Empty slots sit at infinity, every slab distance comes out as infinite on the same side so the test always fails
+	if (binaryIndex == UINT32_MAX)
+	{
+		Node& node = _nodes[nodeIndex];
+		node.minX[slot] = node.minY[slot] = node.minZ[slot] = INFINITY;
+		node.maxX[slot] = node.maxY[slot] = node.maxZ[slot] = INFINITY;
+		node.child[slot] = 0;
+		node.primCount[slot] = 0;
+		return;
+	}
+
+	const LinearBvh::Node& binaryNode = bvh.GetNodes()[binaryIndex];
+	uint32_t child = 0;
+
+	if (binaryNode.primCount > 0)
+	{
+		//Leaves copy their primitives out so the wide tree's leaves sit next to each other in traversal order
+		child = static_cast<uint32_t>(_primIndices.size());
+		for (uint32_t i = 0; i < binaryNode.primCount; ++i)
+		{
+			_primIndices.push_back(bvh.GetPrimIndices()[binaryNode.offset + i]);
+		}
+	}
+	else
+	{
+		//Collapsing can grow the node array so only hold onto the index across this call
+		child = CollapseNode(bvh, binaryIndex);
+	}
+
+	Node& node = _nodes[nodeIndex];
+	AA::Vec3 min = binaryNode.box.Min();
+	AA::Vec3 max = binaryNode.box.Max();
+
+	//Round outwards when dropping to float so the box can only grow
+	node.minX[slot] = std::nextafter(static_cast<float>(min.X()), -INFINITY);
+	node.minY[slot] = std::nextafter(static_cast<float>(min.Y()), -INFINITY);
+	node.minZ[slot] = std::nextafter(static_cast<float>(min.Z()), -INFINITY);
+	node.maxX[slot] = std::nextafter(static_cast<float>(max.X()), INFINITY);
+	node.maxY[slot] = std::nextafter(static_cast<float>(max.Y()), INFINITY);
+	node.maxZ[slot] = std::nextafter(static_cast<float>(max.Z()), INFINITY);
+	node.child[slot] = child;
+	node.primCount[slot] = binaryNode.primCount;
+}